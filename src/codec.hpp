@@ -0,0 +1,456 @@
+#ifndef CODEC_INCLUDED
+#define CODEC_INCLUDED
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// compact encodings for the .pmxc index and vertex blobs. decoders throw std::runtime_error on
+// truncated or corrupted input and never write past the output they are given.
+namespace MeshCodec {
+
+    inline void put_u32(std::vector<uint8_t>& out, uint32_t v) {
+        uint8_t bytes[4];
+        std::memcpy(bytes, &v, sizeof(v));
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+
+    inline uint32_t get_u32(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline void put_varint(std::vector<uint8_t>& out, uint32_t v) {
+        while (v >= 0x80) {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    inline uint32_t get_varint(const uint8_t*& p, const uint8_t* end) {
+        uint32_t v = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (p == end) {
+                throw std::runtime_error("truncated index stream");
+            }
+            uint8_t byte = *p++;
+            v |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (byte < 0x80) {
+                return v;
+            }
+        }
+        throw std::runtime_error("corrupted index stream");
+    }
+
+    inline uint32_t zigzag(int32_t v) {
+        return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+    }
+
+    inline int32_t unzigzag(uint32_t v) {
+        return static_cast<int32_t>((v >> 1) ^ (0u - (v & 1)));
+    }
+
+    // index stream: u32 index count, one code byte per triangle, then zigzag varints.
+    // a code's bits 0-1 name the edge of the previous triangle this one shares in reverse (3: none),
+    // which covers both strips and fans; the triangle is then emitted rotated to start with that edge.
+    // bits 2-4 flag vertices equal to the next unseen one (highest so far + 1), which need no varint;
+    // any other vertex is a delta from the last explicit one. bits 5-6 undo the rotation, so decoding
+    // reproduces the input exactly.
+    const uint8_t INDEX_NO_EDGE = 3;
+
+    template <typename Index>
+    std::vector<uint8_t> encode_indices(const Index* indices, size_t count) {
+        size_t triangle_count = count / 3;
+        std::vector<uint8_t> codes, data;
+        codes.reserve(triangle_count);
+        data.reserve(triangle_count * 2);
+
+        uint32_t prev[3] = {0, 0, 0};
+        bool has_prev = false;
+        uint32_t next = 0, last = 0;
+        auto put_vertex = [&](uint32_t v, int k, uint8_t& code) {
+            if (v == next) {
+                code |= static_cast<uint8_t>(4 << k);
+                next++;
+            } else {
+                put_varint(data, zigzag(static_cast<int32_t>(v - last)));
+                last = v;
+                next = std::max(next, v + 1);
+            }
+        };
+
+        for (size_t t = 0; t < triangle_count; ++t) {
+            uint32_t tri[3] = {indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]};
+            uint8_t code = INDEX_NO_EDGE;
+            uint32_t out[3] = {tri[0], tri[1], tri[2]};
+            for (int e = 0; e < 3 && has_prev && code == INDEX_NO_EDGE; ++e) {
+                uint32_t x = prev[e], y = prev[(e + 1) % 3];
+                for (int r = 0; r < 3; ++r) {
+                    if (tri[r] == y && tri[(r + 1) % 3] == x) {
+                        code = static_cast<uint8_t>(e | r << 5);
+                        out[0] = y;
+                        out[1] = x;
+                        out[2] = tri[(r + 2) % 3];
+                        break;
+                    }
+                }
+            }
+            if (code == INDEX_NO_EDGE) {
+                for (int k = 0; k < 3; ++k) {
+                    put_vertex(out[k], k, code);
+                }
+            } else {
+                put_vertex(out[2], 0, code);
+            }
+            codes.push_back(code);
+            std::copy(out, out + 3, prev);
+            has_prev = true;
+        }
+        // a trailing partial triangle, if any, as plain varints
+        for (size_t j = 3 * triangle_count; j < count; ++j) {
+            put_varint(data, static_cast<uint32_t>(indices[j]));
+        }
+
+        std::vector<uint8_t> encoded;
+        encoded.reserve(4 + codes.size() + data.size());
+        put_u32(encoded, static_cast<uint32_t>(count));
+        encoded.insert(encoded.end(), codes.begin(), codes.end());
+        encoded.insert(encoded.end(), data.begin(), data.end());
+        return encoded;
+    }
+
+    inline size_t decoded_index_count(const uint8_t* data, size_t size) {
+        if (size < 4) {
+            throw std::runtime_error("truncated index stream");
+        }
+        // every triangle has one code byte (its indices may all be cache or next-vertex hits, with no
+        // varint) and every index of a trailing partial triangle at least one varint byte, so the
+        // payload bounds the count before anyone allocates for it
+        size_t count = get_u32(data);
+        if (count / 3 + count % 3 > size - 4) {
+            throw std::runtime_error("index count exceeds index stream");
+        }
+        return count;
+    }
+
+    // out holds decoded_index_count() indices; every index must be below vertex_count
+    template <typename Index>
+    void decode_indices(Index* out, const uint8_t* data, size_t size, size_t vertex_count) {
+        size_t count = decoded_index_count(data, size);
+        size_t triangle_count = count / 3;
+        if (size - 4 < triangle_count) {
+            throw std::runtime_error("truncated index stream");
+        }
+        const uint8_t* codes = data + 4;
+        const uint8_t* p = codes + triangle_count;
+        const uint8_t* end = data + size;
+
+        uint32_t prev[3] = {0, 0, 0};
+        uint32_t next = 0, last = 0;
+        auto get_vertex = [&](uint8_t code, int k) {
+            uint32_t v;
+            if (code & (4 << k)) {
+                v = next++;
+            } else {
+                v = last + static_cast<uint32_t>(unzigzag(get_varint(p, end)));
+                last = v;
+                next = std::max(next, v + 1);
+            }
+            if (v >= vertex_count) {
+                throw std::runtime_error("index out of range in index stream");
+            }
+            return v;
+        };
+
+        for (size_t t = 0; t < triangle_count; ++t) {
+            uint8_t code = codes[t];
+            uint8_t edge = code & 3;
+            uint32_t tri[3];
+            if (edge == INDEX_NO_EDGE) {
+                tri[0] = get_vertex(code, 0);
+                tri[1] = get_vertex(code, 1);
+                tri[2] = get_vertex(code, 2);
+            } else {
+                if (t == 0 || edge > 2) {
+                    throw std::runtime_error("corrupted index stream");
+                }
+                tri[0] = prev[(edge + 1) % 3];
+                tri[1] = prev[edge];
+                tri[2] = get_vertex(code, 0);
+            }
+            int rotation = (code >> 5) & 3;
+            if (rotation > 2) {
+                throw std::runtime_error("corrupted index stream");
+            }
+            out[3 * t] = static_cast<Index>(tri[(3 - rotation) % 3]);
+            out[3 * t + 1] = static_cast<Index>(tri[(4 - rotation) % 3]);
+            out[3 * t + 2] = static_cast<Index>(tri[(5 - rotation) % 3]);
+            std::copy(tri, tri + 3, prev);
+        }
+        for (size_t j = 3 * triangle_count; j < count; ++j) {
+            uint32_t v = get_varint(p, end);
+            if (v >= vertex_count) {
+                throw std::runtime_error("index out of range in index stream");
+            }
+            out[j] = static_cast<Index>(v);
+        }
+    }
+
+    // vertex stream: u32 vertex count, u32 stride, then blocks of VERTEX_BLOCK vertices. each block
+    // stores every byte plane (byte k of each vertex) as zigzag deltas from the previous vertex, in
+    // groups of 16 with a 2-bit width per group (0, 2, 4 or 8 bits per delta). the decoder unpacks
+    // a group, prefix sums it and transposes the planes back with SSE2.
+    const size_t VERTEX_BLOCK = 256;
+    const size_t VERTEX_MAX_STRIDE = 64;
+    const size_t VERTEX_TAIL = 16;  // zero padding so the decoder's last wide load stays in the stream
+
+    inline std::vector<uint8_t> encode_vertices(const void* vertices, size_t count, size_t stride) {
+        if (stride == 0 || stride > VERTEX_MAX_STRIDE) {
+            throw std::runtime_error("unsupported vertex stride");
+        }
+        const uint8_t* src = static_cast<const uint8_t*>(vertices);
+        std::vector<uint8_t> encoded;
+        put_u32(encoded, static_cast<uint32_t>(count));
+        put_u32(encoded, static_cast<uint32_t>(stride));
+
+        uint8_t prev[VERTEX_MAX_STRIDE] = {};
+        uint8_t deltas[VERTEX_BLOCK];
+        for (size_t first = 0; first < count; first += VERTEX_BLOCK) {
+            size_t n = std::min(VERTEX_BLOCK, count - first);
+            size_t groups = (n + 15) / 16;
+            for (size_t k = 0; k < stride; ++k) {
+                uint8_t last = prev[k];
+                std::fill(deltas, deltas + VERTEX_BLOCK, 0);
+                for (size_t i = 0; i < n; ++i) {
+                    uint8_t v = src[(first + i) * stride + k];
+                    int8_t d = static_cast<int8_t>(static_cast<uint8_t>(v - last));
+                    deltas[i] = static_cast<uint8_t>((static_cast<uint8_t>(d) << 1) ^ static_cast<uint8_t>(d >> 7));
+                    last = v;
+                }
+                prev[k] = last;
+
+                size_t header = encoded.size();
+                encoded.resize(encoded.size() + (groups + 3) / 4, 0);
+                for (size_t g = 0; g < groups; ++g) {
+                    const uint8_t* z = deltas + 16 * g;
+                    uint8_t widest = *std::max_element(z, z + 16);
+                    uint8_t mode = widest == 0 ? 0 : widest < 4 ? 1 : widest < 16 ? 2 : 3;
+                    encoded[header + g / 4] |= static_cast<uint8_t>(mode << (2 * (g % 4)));
+                    if (mode == 1) {
+                        for (int j = 0; j < 16; j += 4) {
+                            encoded.push_back(static_cast<uint8_t>(z[j] | z[j + 1] << 2 | z[j + 2] << 4 | z[j + 3] << 6));
+                        }
+                    } else if (mode == 2) {
+                        for (int j = 0; j < 16; j += 2) {
+                            encoded.push_back(static_cast<uint8_t>(z[j] | z[j + 1] << 4));
+                        }
+                    } else if (mode == 3) {
+                        encoded.insert(encoded.end(), z, z + 16);
+                    }
+                }
+            }
+        }
+        encoded.resize(encoded.size() + VERTEX_TAIL, 0);
+        return encoded;
+    }
+
+    inline size_t decoded_vertex_count(const uint8_t* data, size_t size, size_t stride) {
+        if (size < 8) {
+            throw std::runtime_error("truncated vertex stream");
+        }
+        if (get_u32(data + 4) != stride) {
+            throw std::runtime_error("vertex stream stride mismatch");
+        }
+        // every block stores at least its group headers for each byte plane
+        size_t count = get_u32(data);
+        size_t last_groups = (count % VERTEX_BLOCK + 15) / 16;
+        size_t headers = stride * ((count / VERTEX_BLOCK) * (VERTEX_BLOCK / 16 / 4) + (last_groups + 3) / 4);
+        if (headers > size - 8) {
+            throw std::runtime_error("vertex count exceeds vertex stream");
+        }
+        return count;
+    }
+
+    const size_t VERTEX_GROUP_BYTES[4] = {0, 4, 8, 16};
+
+    // payload bytes of the four groups a header byte describes
+    const struct VertexHeaderTable {
+        uint8_t bytes[256];
+        VertexHeaderTable() {
+            for (int h = 0; h < 256; ++h) {
+                bytes[h] = static_cast<uint8_t>(VERTEX_GROUP_BYTES[h & 3] + VERTEX_GROUP_BYTES[(h >> 2) & 3]
+                                              + VERTEX_GROUP_BYTES[(h >> 4) & 3] + VERTEX_GROUP_BYTES[h >> 6]);
+            }
+        }
+        uint8_t operator[](uint8_t h) const { return bytes[h]; }
+    } VERTEX_HEADER_BYTES;
+
+    // one plane of a block: 16 deltas per group, accumulated onto last
+    inline void decode_plane_scalar(const uint8_t* header, const uint8_t*& p, size_t groups, uint8_t& last, uint8_t* plane) {
+        for (size_t g = 0; g < groups; ++g) {
+            uint8_t mode = (header[g / 4] >> (2 * (g % 4))) & 3;
+            for (int j = 0; j < 16; ++j) {
+                uint8_t z = mode == 0 ? 0
+                          : mode == 1 ? (p[j / 4] >> (2 * (j % 4))) & 3
+                          : mode == 2 ? (p[j / 2] >> (4 * (j % 2))) & 15
+                          : p[j];
+                last = static_cast<uint8_t>(last + ((z >> 1) ^ (0u - (z & 1))));
+                plane[16 * g + j] = last;
+            }
+            p += VERTEX_GROUP_BYTES[mode];
+        }
+    }
+
+#if defined(__SSE2__)
+    // per group width, which of the 2-bit, 4-bit and raw unpacks to keep
+    alignas(16) const uint32_t VERTEX_GROUP_SELECT[4][3][4] = {
+        {{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}},
+        {{~0u, ~0u, ~0u, ~0u}, {0, 0, 0, 0}, {0, 0, 0, 0}},
+        {{0, 0, 0, 0}, {~0u, ~0u, ~0u, ~0u}, {0, 0, 0, 0}},
+        {{0, 0, 0, 0}, {0, 0, 0, 0}, {~0u, ~0u, ~0u, ~0u}},
+    };
+
+    // branchless: every group loads 16 bytes, so the caller guarantees VERTEX_TAIL readable bytes past the payload
+    inline void decode_plane(const uint8_t* header, const uint8_t*& p, size_t groups, uint8_t& last, uint8_t* plane) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi8(1);
+        const __m128i low2 = _mm_set1_epi8(3);
+        const __m128i low4 = _mm_set1_epi8(15);
+        const __m128i low7 = _mm_set1_epi8(0x7F);
+        // byte j of a 2-bit group sits at bit 2 * (j % 4) of its source byte
+        const __m128i lane0 = _mm_set1_epi32(0x000000FF);
+        const __m128i lane1 = _mm_set1_epi32(0x0000FF00);
+        const __m128i lane2 = _mm_set1_epi32(0x00FF0000);
+        const __m128i lane3 = _mm_set1_epi32(static_cast<int>(0xFF000000));
+        __m128i carry = _mm_set1_epi8(static_cast<char>(last));
+        for (size_t g = 0; g < groups; ++g) {
+            uint8_t mode = (header[g / 4] >> (2 * (g % 4))) & 3;
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            p += VERTEX_GROUP_BYTES[mode];
+
+            __m128i x4 = _mm_unpacklo_epi8(x, x);
+            x4 = _mm_unpacklo_epi16(x4, x4);  // each of the first 4 bytes repeated 4 times
+            __m128i bits2 = _mm_or_si128(
+                _mm_or_si128(_mm_and_si128(x4, lane0), _mm_and_si128(_mm_srli_epi16(x4, 2), lane1)),
+                _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x4, 4), lane2), _mm_and_si128(_mm_srli_epi16(x4, 6), lane3)));
+            bits2 = _mm_and_si128(bits2, low2);
+            __m128i bits4 = _mm_unpacklo_epi8(_mm_and_si128(x, low4), _mm_and_si128(_mm_srli_epi16(x, 4), low4));
+
+            const __m128i* select = reinterpret_cast<const __m128i*>(VERTEX_GROUP_SELECT[mode]);
+            __m128i z = _mm_or_si128(
+                _mm_or_si128(_mm_and_si128(bits2, _mm_load_si128(select)), _mm_and_si128(bits4, _mm_load_si128(select + 1))),
+                _mm_and_si128(x, _mm_load_si128(select + 2)));
+
+            __m128i d = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(z, 1), low7), _mm_sub_epi8(zero, _mm_and_si128(z, one)));
+            d = _mm_add_epi8(d, _mm_slli_si128(d, 1));
+            d = _mm_add_epi8(d, _mm_slli_si128(d, 2));
+            d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+            d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+            d = _mm_add_epi8(d, carry);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(plane + 16 * g), d);
+            // broadcast byte 15 for the next group
+            carry = _mm_unpackhi_epi8(d, d);
+            carry = _mm_shufflehi_epi16(carry, _MM_SHUFFLE(3, 3, 3, 3));
+            carry = _mm_shuffle_epi32(carry, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+        last = static_cast<uint8_t>(_mm_cvtsi128_si32(carry));
+    }
+
+    // planes[k][i] -> out[i * stride + k] for 16 vertices, stride 4 or 8
+    inline void transpose16(const uint8_t* planes, size_t plane_pitch, size_t stride, uint8_t* out) {
+        __m128i quads[2][4];
+        for (size_t q = 0; q < stride / 4; ++q) {
+            const uint8_t* base = planes + 4 * q * plane_pitch;
+            __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base));
+            __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + plane_pitch));
+            __m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + 2 * plane_pitch));
+            __m128i p3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + 3 * plane_pitch));
+            __m128i a = _mm_unpacklo_epi8(p0, p1), b = _mm_unpackhi_epi8(p0, p1);
+            __m128i c = _mm_unpacklo_epi8(p2, p3), d = _mm_unpackhi_epi8(p2, p3);
+            quads[q][0] = _mm_unpacklo_epi16(a, c);  // vertices 0-3, bytes 4q..4q+3
+            quads[q][1] = _mm_unpackhi_epi16(a, c);
+            quads[q][2] = _mm_unpacklo_epi16(b, d);
+            quads[q][3] = _mm_unpackhi_epi16(b, d);
+        }
+        if (stride == 4) {
+            for (int r = 0; r < 4; ++r) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * r), quads[0][r]);
+            }
+        } else {
+            for (int r = 0; r < 4; ++r) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 32 * r), _mm_unpacklo_epi32(quads[0][r], quads[1][r]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 32 * r + 16), _mm_unpackhi_epi32(quads[0][r], quads[1][r]));
+            }
+        }
+    }
+#else
+    inline void decode_plane(const uint8_t* header, const uint8_t*& p, size_t groups, uint8_t& last, uint8_t* plane) {
+        decode_plane_scalar(header, p, groups, last, plane);
+    }
+#endif
+
+    // out holds decoded_vertex_count() vertices of stride bytes
+    inline void decode_vertices(void* out, size_t stride, const uint8_t* data, size_t size) {
+        size_t count = decoded_vertex_count(data, size, stride);
+        if (stride == 0 || stride > VERTEX_MAX_STRIDE) {
+            throw std::runtime_error("unsupported vertex stride");
+        }
+        uint8_t* dst = static_cast<uint8_t*>(out);
+        const uint8_t* p = data + 8;
+        const uint8_t* end = data + size;
+
+        uint8_t prev[VERTEX_MAX_STRIDE] = {};
+        alignas(16) uint8_t planes[VERTEX_MAX_STRIDE * VERTEX_BLOCK];
+        for (size_t first = 0; first < count; first += VERTEX_BLOCK) {
+            size_t n = std::min(VERTEX_BLOCK, count - first);
+            size_t groups = (n + 15) / 16;
+            for (size_t k = 0; k < stride; ++k) {
+                const uint8_t* header = p;
+                size_t header_size = (groups + 3) / 4;
+                if (static_cast<size_t>(end - p) < header_size) {
+                    throw std::runtime_error("truncated vertex stream");
+                }
+                // unused widths in the last header byte are zero, so whole bytes can be summed
+                size_t payload = 0;
+                for (size_t h = 0; h < header_size; ++h) {
+                    payload += VERTEX_HEADER_BYTES[header[h]];
+                }
+                p += header_size;
+                if (static_cast<size_t>(end - p) < payload) {
+                    throw std::runtime_error("truncated vertex stream");
+                }
+                if (static_cast<size_t>(end - p) >= payload + VERTEX_TAIL) {
+                    decode_plane(header, p, groups, prev[k], planes + k * VERTEX_BLOCK);
+                } else {
+                    decode_plane_scalar(header, p, groups, prev[k], planes + k * VERTEX_BLOCK);
+                }
+            }
+
+            uint8_t* block = dst + first * stride;
+            size_t i = 0;
+#if defined(__SSE2__)
+            if (stride == 4 || stride == 8) {
+                for (; i + 16 <= n; i += 16) {
+                    transpose16(planes + i, VERTEX_BLOCK, stride, block + i * stride);
+                }
+            }
+#endif
+            for (; i < n; ++i) {
+                for (size_t k = 0; k < stride; ++k) {
+                    block[i * stride + k] = planes[k * VERTEX_BLOCK + i];
+                }
+            }
+        }
+    }
+
+}
+
+#endif
@@ -13,7 +13,8 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-#include "mmd.hpp"
+#include "pmxc.hpp"
+#include "texcache.hpp"
 
 #include <iostream>
 #include <stdexcept>
@@ -23,6 +24,12 @@
 #include <set>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <algorithm>
 #include <filesystem>
 
 #define WIDTH 1200
@@ -31,49 +38,54 @@
 const std::string MODEL_VERTEX_SHADER_PATH = "spir-v/toon_model.vert.spv";
 const std::string EDGE_VERTEX_SHADER_PATH = "spir-v/toon_edge.vert.spv";
 const std::string FRAGMENT_SHADER_PATH = "spir-v/toon_tex.frag.spv";
+const std::string CULL_COMPUTE_SHADER_PATH = "spir-v/cull_meshlets.comp.spv";
 const std::string PMX_PATH = "ying/ying.pmx";
 //const std::string PMX_PATH = "paimeng/paimeng.pmx";
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
-struct Vertex {
-    glm::vec3 pos;
-    glm::vec3 color;
-    glm::vec2 texCoord;
-    int texID;
+// the coarsest level of detail whose error stays within this many pixels is drawn
+const float LOD_PIXEL_ERROR = 1.0f;
 
-    static vk::VertexInputBindingDescription getBindingDescription() {
-        vk::VertexInputBindingDescription bindingDescription(0, sizeof(Vertex), vk::VertexInputRate::eVertex);
+// how far toon_edge.vert pushes vertices along the normal; the edge pass culls against spheres grown by it
+const float EDGE_OFFSET = 0.05f;
 
-        return bindingDescription;
+// binding 0: position + normal, binding 1: texCoord.
+// position-only pipelines (the edge pass) declare binding 0 alone and never fetch binding 1.
+struct VertexInput {
+    static std::vector<vk::VertexInputBindingDescription> getBindingDescriptions(bool positionOnly) {
+        std::vector<vk::VertexInputBindingDescription> bindingDescriptions = {
+            vk::VertexInputBindingDescription(0, sizeof(Model::PackedPosition), vk::VertexInputRate::eVertex),
+        };
+        if (!positionOnly) {
+            bindingDescriptions.push_back(vk::VertexInputBindingDescription(1, sizeof(Model::PackedAttributes), vk::VertexInputRate::eVertex));
+        }
+
+        return bindingDescriptions;
     }
 
-    static std::array<vk::VertexInputAttributeDescription, 4> getAttributeDescriptions() {
-        std::array<vk::VertexInputAttributeDescription, 4> attributeDescriptions{};
+    static std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions(bool positionOnly) {
+        std::vector<vk::VertexInputAttributeDescription> attributeDescriptions(positionOnly ? 2 : 3);
 
-        // float: eR32Sfloat
-        // vec2: R32G32Sfloat
-        // vec3: R32G32B32Sfloat
-        // vec4: R32G32B32A32Sfloat
+        // pos: unorm16 x3, decoded with ubo.positionScale/positionBias.
+        // read as 4 lanes (3 lane 16-bit formats are not mandatory); the 4th overlaps the normal and is ignored
         attributeDescriptions[0].binding = 0;
         attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format = vk::Format::eR32G32B32Sfloat;
-        attributeDescriptions[0].offset = offsetof(Vertex, pos);
+        attributeDescriptions[0].format = vk::Format::eR16G16B16A16Uint;
+        attributeDescriptions[0].offset = offsetof(Model::PackedPosition, pos);
 
+        // octahedral normal
         attributeDescriptions[1].binding = 0;
         attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format = vk::Format::eR32G32B32Sfloat;
-        attributeDescriptions[1].offset = offsetof(Vertex, color);
-
-        attributeDescriptions[2].binding = 0;
-        attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format = vk::Format::eR32G32Sfloat;
-        attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
-
-        attributeDescriptions[3].binding = 0;
-        attributeDescriptions[3].location = 3;
-        attributeDescriptions[3].format = vk::Format::eR32Uint;
-        attributeDescriptions[3].offset = offsetof(Vertex, texID);
+        attributeDescriptions[1].format = vk::Format::eR8G8Snorm;
+        attributeDescriptions[1].offset = offsetof(Model::PackedPosition, normal);
+
+        if (!positionOnly) {
+            attributeDescriptions[2].binding = 1;
+            attributeDescriptions[2].location = 2;
+            attributeDescriptions[2].format = vk::Format::eR16G16Sfloat;
+            attributeDescriptions[2].offset = offsetof(Model::PackedAttributes, texCoord);
+        }
 
         return attributeDescriptions;
     }
@@ -84,6 +96,25 @@ struct UniformBufferObject {
     glm::mat4 view;
     glm::mat4 proj;
     glm::mat4 invModel;
+    glm::vec4 positionScale;
+    glm::vec4 positionBias;
+    glm::vec4 camera; // model space, for the cull shader's cone test and lod selection
+    float edgeOffset; // EDGE_OFFSET, shared by toon_edge.vert and the cull shader
+};
+
+// per draw: the material's texture, so the sampler array index is dynamically uniform
+struct DrawConstants {
+    uint32_t texID;
+    uint32_t srgbGray; // 1: the texture is bc4 holding sRGB coded gray, which toon_tex.frag linearizes
+};
+
+// matches CullConstants in cull_meshlets.comp
+struct CullConstants {
+    uint32_t firstMeshlet;  // the level of detail being drawn
+    uint32_t meshletCount;
+    uint32_t totalMeshlets; // every level's; the edge pass commands start here
+    uint32_t drawCount;
+    uint32_t compact; // 1: visible meshlets are packed per draw for drawIndexedIndirectCount
 };
 
 class Renderer {
@@ -91,6 +122,7 @@ private:
     vk::Device& deviceRef;
     vklearn::SwapChainDetails& swapChainDetails;
     vk::RenderPass& renderPassRef;
+    uint32_t textureCapacity;
 
 public:
     vk::DescriptorSetLayout descriptorSetLayout;
@@ -99,9 +131,10 @@ public:
     std::string vertexShaderPath;
     std::string fragmentShaderPath;
     vk::CullModeFlags cullModeFlags;
+    bool positionOnly;
 
-    Renderer(vk::Device& dr, vklearn::SwapChainDetails& scd, vk::RenderPass& rpr, std::string vsp, std::string fsp, vk::CullModeFlags cmf)
-    : deviceRef(dr), swapChainDetails(scd), renderPassRef(rpr), vertexShaderPath(vsp), fragmentShaderPath(fsp), cullModeFlags(cmf) {
+    Renderer(vk::Device& dr, vklearn::SwapChainDetails& scd, vk::RenderPass& rpr, uint32_t tc, std::string vsp, std::string fsp, vk::CullModeFlags cmf, bool po = false)
+    : deviceRef(dr), swapChainDetails(scd), renderPassRef(rpr), textureCapacity(tc), vertexShaderPath(vsp), fragmentShaderPath(fsp), cullModeFlags(cmf), positionOnly(po) {
         recreate();
     }
 
@@ -129,21 +162,32 @@ public:
             vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, // only referencing from vertex shader
             nullptr // only relevant for image sampling
             );
+        // bindless: each set is allocated with as many slots as the model has textures, and slots
+        // are written as textures become resident without re-recording the command buffers
         vk::DescriptorSetLayoutBinding samplerLayoutBinding(
             1,
             vk::DescriptorType::eCombinedImageSampler,
-            8,
+            textureCapacity, // upper bound for the variable count
             vk::ShaderStageFlagBits::eFragment,
             nullptr
         );
 
         std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
+        std::array<vk::DescriptorBindingFlags, 2> bindingFlags = {
+            vk::DescriptorBindingFlags{},
+            vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eVariableDescriptorCount | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
+        };
+        vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo(
+            static_cast<uint32_t>(bindingFlags.size()),
+            bindingFlags.data()
+        );
 
         vk::DescriptorSetLayoutCreateInfo layoutInfo(
-            {},
+            vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
             static_cast<uint32_t>(bindings.size()),
             bindings.data()
         );
+        layoutInfo.setPNext(&bindingFlagsInfo);
 
         if (deviceRef.createDescriptorSetLayout(&layoutInfo, nullptr, &descriptorSetLayout) != vk::Result::eSuccess) {
             throw std::runtime_error("failed to create descriptor set layout!");
@@ -167,12 +211,12 @@ public:
             "main");
         
         vk::PipelineShaderStageCreateInfo shaderStages[2] = {vertShaderStageInfo, fragShaderStageInfo};
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+        auto bindingDescriptions = VertexInput::getBindingDescriptions(positionOnly);
+        auto attributeDescriptions = VertexInput::getAttributeDescriptions(positionOnly);
         vk::PipelineVertexInputStateCreateInfo vertexInputInfo(
             {},
-            1,
-            &bindingDescription,
+            static_cast<uint32_t>(bindingDescriptions.size()),
+            bindingDescriptions.data(),
             static_cast<uint32_t>(attributeDescriptions.size()),
             attributeDescriptions.data()
         );
@@ -273,12 +317,13 @@ public:
             dynamicStates
         );
 
+        vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eFragment, 0, sizeof(DrawConstants));
         vk::PipelineLayoutCreateInfo pipelineLayoutInfo(
             {},
             1, // descriptorSetLayoutCount
             &descriptorSetLayout, // descriptorSetLayouts
-            0,
-            nullptr
+            1,
+            &pushConstantRange
         );
         
         if (deviceRef.createPipelineLayout(&pipelineLayoutInfo, nullptr, &pipelineLayout) != vk::Result::eSuccess) {
@@ -315,6 +360,381 @@ public:
     
 };
 
+// compute pipeline of cull_meshlets.comp: ubo, meshlets, then the command and count buffers it writes
+class MeshletCuller {
+private:
+    vk::Device& deviceRef;
+
+public:
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline computePipeline;
+    std::string computeShaderPath;
+
+    MeshletCuller(vk::Device& dr, std::string csp)
+    : deviceRef(dr), computeShaderPath(csp) {
+        createDescriptorSetLayout();
+        createComputePipeline();
+    }
+
+    ~MeshletCuller() {
+        deviceRef.destroyDescriptorSetLayout(descriptorSetLayout);
+        deviceRef.destroyPipeline(computePipeline);
+        deviceRef.destroyPipelineLayout(pipelineLayout);
+    }
+
+    void createDescriptorSetLayout() {
+        std::array<vk::DescriptorSetLayoutBinding, 4> bindings = {
+            vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+            vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+            vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+            vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+        };
+
+        vk::DescriptorSetLayoutCreateInfo layoutInfo(
+            {},
+            static_cast<uint32_t>(bindings.size()),
+            bindings.data()
+        );
+
+        if (deviceRef.createDescriptorSetLayout(&layoutInfo, nullptr, &descriptorSetLayout) != vk::Result::eSuccess) {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+    }
+
+    void createComputePipeline() {
+        vk::ShaderModule compShaderModule = vklearn::createShaderModuleFromFile(deviceRef, computeShaderPath);
+
+        vk::PipelineShaderStageCreateInfo compShaderStageInfo(
+            {},
+            vk::ShaderStageFlagBits::eCompute,
+            compShaderModule,
+            "main");
+
+        vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullConstants));
+        vk::PipelineLayoutCreateInfo pipelineLayoutInfo(
+            {},
+            1,
+            &descriptorSetLayout,
+            1,
+            &pushConstantRange
+        );
+
+        if (deviceRef.createPipelineLayout(&pipelineLayoutInfo, nullptr, &pipelineLayout) != vk::Result::eSuccess) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        vk::ComputePipelineCreateInfo pipelineInfo(
+            {},
+            compShaderStageInfo,
+            pipelineLayout
+        );
+        if (deviceRef.createComputePipelines(nullptr, 1, &pipelineInfo, nullptr, &computePipeline) != vk::Result::eSuccess) {
+            throw std::runtime_error("failed to create compute pipeline!");
+        }
+
+        deviceRef.destroyShaderModule(compShaderModule);
+    }
+};
+
+// decodes every texture with stb_image on a worker pool. next() hands them out in completion
+// order, so the caller uploads one texture while the others are still decoding.
+// with compress, each texture is instead mapped from its block-compressed TextureCache file,
+// which is encoded first when missing or stale.
+class TextureDecoder {
+public:
+    struct Texture {
+        size_t index = 0;
+        stbi_uc* pixels = nullptr;  // freed by the caller with stbi_image_free
+        std::unique_ptr<TextureCache::Texture> compressed;  // instead of pixels
+        int width = 0;
+        int height = 0;
+        std::string error;
+        double decodeMs = 0.0;
+    };
+
+    size_t threadCount = 0;
+
+    TextureDecoder(const std::vector<std::filesystem::path>& ps, bool c)
+    : paths(ps), compress(c) {
+        unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        threadCount = std::min<size_t>(hardwareThreads, paths.size());
+        // encoders split each level across threads, so the pool together stays near the core count
+        encodeThreads = threadCount > 0 ? std::max<unsigned>(1, hardwareThreads / threadCount) : 1;
+        for (size_t t = 0; t < threadCount; ++t) {
+            workers.emplace_back([this] { decode(); });
+        }
+    }
+
+    ~TextureDecoder() {
+        stopping = true;
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (auto& texture : finished) {
+            stbi_image_free(texture.pixels);
+        }
+    }
+
+    // blocks until another texture is decoded; call once per path
+    Texture next() {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return !finished.empty(); });
+        Texture texture = std::move(finished.front());
+        finished.pop_front();
+        return texture;
+    }
+
+    // non-blocking next(): false when nothing new has been decoded
+    bool poll(Texture& texture) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (finished.empty()) {
+            return false;
+        }
+        texture = std::move(finished.front());
+        finished.pop_front();
+        return true;
+    }
+
+private:
+    const std::vector<std::filesystem::path>& paths;
+    bool compress;
+    unsigned encodeThreads;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextIndex{0};
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Texture> finished;
+
+    void decode() {
+        for (size_t j = nextIndex++; j < paths.size() && !stopping; j = nextIndex++) {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            Texture texture;
+            texture.index = j;
+            if (compress) {
+                try {
+                    texture.compressed = std::make_unique<TextureCache::Texture>(TextureCache::load(paths[j].string(), encodeThreads));
+                    texture.width = static_cast<int>(texture.compressed->width);
+                    texture.height = static_cast<int>(texture.compressed->height);
+                } catch (const std::exception& e) {
+                    texture.error = e.what();
+                }
+            } else {
+                int channels;
+                texture.pixels = stbi_load(paths[j].c_str(), &texture.width, &texture.height, &channels, STBI_rgb_alpha);
+                if (!texture.pixels) {
+                    texture.error = stbi_failure_reason() ? stbi_failure_reason() : "unknown error";  // thread local
+                }
+            }
+            auto endTime = std::chrono::high_resolution_clock::now();
+            texture.decodeMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.push_back(std::move(texture));
+            }
+            ready.notify_one();
+        }
+    }
+};
+
+// records uploads from a staging buffer into device local buffers and images and submits them
+// without waiting. copies run on the transfer queue; with a transfer-only family their ownership
+// is released there and acquired on the graphics queue, which also runs anything that needs it
+// (mip blits). every submit signals the timeline semaphore, and a resource is usable once the
+// semaphore reaches the value submit() returned.
+class Uploader {
+public:
+    struct Batch {
+        vk::Buffer stagingBuffer;
+        vk::DeviceMemory stagingBufferMemory;
+        uint8_t* staging = nullptr;  // mapped stagingBuffer
+        vk::CommandBuffer transfer;  // copies, recorded for the transfer queue
+        vk::CommandBuffer graphics;  // acquires and blits, recorded for the graphics queue
+        uint64_t value = 0;
+    };
+
+    vk::Semaphore timeline;
+
+    Uploader(vk::Device& dr, vk::PhysicalDevice pd, uint32_t gf, vk::Queue gq, uint32_t tf, vk::Queue tq)
+    : deviceRef(dr), physicalDevice(pd), graphicsFamily(gf), graphicsQueue(gq), transferFamily(tf), transferQueue(tq) {
+        vk::SemaphoreTypeCreateInfo typeInfo(vk::SemaphoreType::eTimeline, 0);
+        vk::SemaphoreCreateInfo semaphoreInfo;
+        semaphoreInfo.setPNext(&typeInfo);
+        if (deviceRef.createSemaphore(&semaphoreInfo, nullptr, &timeline) != vk::Result::eSuccess) {
+            throw std::runtime_error("failed to create upload timeline semaphore!");
+        }
+
+        vk::CommandPoolCreateInfo transferPoolInfo(vk::CommandPoolCreateFlagBits::eTransient, transferFamily);
+        vk::CommandPoolCreateInfo graphicsPoolInfo(vk::CommandPoolCreateFlagBits::eTransient, graphicsFamily);
+        if (deviceRef.createCommandPool(&transferPoolInfo, nullptr, &transferPool) != vk::Result::eSuccess
+            || deviceRef.createCommandPool(&graphicsPoolInfo, nullptr, &graphicsPool) != vk::Result::eSuccess) {
+            throw std::runtime_error("failed to create upload command pools!");
+        }
+    }
+
+    ~Uploader() {
+        wait(submitted);
+        collect();
+        deviceRef.destroyCommandPool(transferPool);
+        deviceRef.destroyCommandPool(graphicsPool);
+        deviceRef.destroySemaphore(timeline);
+    }
+
+    bool ownershipTransfer() const {
+        return transferFamily != graphicsFamily;
+    }
+
+    Batch begin(vk::DeviceSize stagingSize) {
+        Batch batch;
+        std::tie(batch.stagingBuffer, batch.stagingBufferMemory) = vklearn::createBuffer(
+            physicalDevice, deviceRef,
+            stagingSize, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+        );
+        void* data;
+        deviceRef.mapMemory(batch.stagingBufferMemory, 0, stagingSize, {}, &data);
+        batch.staging = static_cast<uint8_t*>(data);
+        batch.transfer = vklearn::beginSingleTimeCommands(deviceRef, transferPool);
+        batch.graphics = vklearn::beginSingleTimeCommands(deviceRef, graphicsPool);
+        return batch;
+    }
+
+    // dstStage/dstAccess: the first use of dst on the graphics queue
+    void copyBuffer(Batch& batch, vk::DeviceSize stagingOffset, vk::Buffer dst, vk::DeviceSize size, vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess) {
+        vk::BufferCopy copyRegion(stagingOffset, 0, size);
+        batch.transfer.copyBuffer(batch.stagingBuffer, dst, 1, &copyRegion);
+        if (!ownershipTransfer()) {
+            return;  // the timeline wait between the two submits already orders the copy
+        }
+        vk::BufferMemoryBarrier release(vk::AccessFlagBits::eTransferWrite, {}, transferFamily, graphicsFamily, dst, 0, VK_WHOLE_SIZE);
+        batch.transfer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, 0, nullptr, 1, &release, 0, nullptr);
+        vk::BufferMemoryBarrier acquire({}, dstAccess, transferFamily, graphicsFamily, dst, 0, VK_WHOLE_SIZE);
+        batch.graphics.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, dstStage, {}, 0, nullptr, 1, &acquire, 0, nullptr);
+    }
+
+    // copies mip 0 and leaves every level in eTransferDstOptimal on the graphics queue, ready for blits
+    void copyImage(Batch& batch, vk::DeviceSize stagingOffset, vk::Image image, uint32_t width, uint32_t height, uint32_t mipLevels) {
+        vk::ImageSubresourceRange base(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+        vk::ImageMemoryBarrier toTransfer(
+            {}, vk::AccessFlagBits::eTransferWrite,
+            vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, base);
+        batch.transfer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, 0, nullptr, 0, nullptr, 1, &toTransfer);
+        vklearn::recordCopyBufferToImage(batch.transfer, batch.stagingBuffer, stagingOffset, image, width, height);
+
+        std::vector<vk::ImageMemoryBarrier> acquires;
+        if (ownershipTransfer()) {
+            vk::ImageMemoryBarrier release(
+                vk::AccessFlagBits::eTransferWrite, {},
+                vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferDstOptimal,
+                transferFamily, graphicsFamily, image, base);
+            batch.transfer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, 0, nullptr, 0, nullptr, 1, &release);
+            acquires.push_back(vk::ImageMemoryBarrier(
+                {}, vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite,
+                vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferDstOptimal,
+                transferFamily, graphicsFamily, image, base));
+        }
+        // the other levels hold nothing yet, so the graphics queue takes them from eUndefined without a transfer
+        if (mipLevels > 1) {
+            acquires.push_back(vk::ImageMemoryBarrier(
+                {}, vk::AccessFlagBits::eTransferWrite,
+                vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image,
+                vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 1, mipLevels - 1, 0, 1)));
+        }
+        if (!acquires.empty()) {
+            batch.graphics.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, 0, nullptr, 0, nullptr,
+                static_cast<uint32_t>(acquires.size()), acquires.data());
+        }
+    }
+
+    // copies every level of a pre-mipped image and leaves it eShaderReadOnlyOptimal for the fragment shader
+    void copyImageLevels(Batch& batch, vk::Image image, const std::vector<vk::BufferImageCopy>& regions, uint32_t mipLevels) {
+        vk::ImageSubresourceRange all(vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1);
+        vk::ImageMemoryBarrier toTransfer(
+            {}, vk::AccessFlagBits::eTransferWrite,
+            vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, all);
+        batch.transfer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, 0, nullptr, 0, nullptr, 1, &toTransfer);
+        batch.transfer.copyBufferToImage(batch.stagingBuffer, image, vk::ImageLayout::eTransferDstOptimal, static_cast<uint32_t>(regions.size()), regions.data());
+
+        // with an ownership transfer the release and acquire also carry the layout change
+        uint32_t srcFamily = ownershipTransfer() ? transferFamily : VK_QUEUE_FAMILY_IGNORED;
+        uint32_t dstFamily = ownershipTransfer() ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+        if (ownershipTransfer()) {
+            vk::ImageMemoryBarrier release(
+                vk::AccessFlagBits::eTransferWrite, {},
+                vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+                srcFamily, dstFamily, image, all);
+            batch.transfer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, 0, nullptr, 0, nullptr, 1, &release);
+        }
+        vk::ImageMemoryBarrier acquire(
+            {}, vk::AccessFlagBits::eShaderRead,
+            vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+            srcFamily, dstFamily, image, all);
+        batch.graphics.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eFragmentShader, {}, 0, nullptr, 0, nullptr, 1, &acquire);
+    }
+
+    // the transfer submit signals value - 1, the graphics submit waits for it and signals value
+    uint64_t submit(Batch& batch) {
+        batch.transfer.end();
+        batch.graphics.end();
+        uint64_t copied = ++submitted;
+        batch.value = ++submitted;
+
+        vk::TimelineSemaphoreSubmitInfo transferTimeline(0, nullptr, 1, &copied);
+        vk::SubmitInfo transferSubmit(0, nullptr, nullptr, 1, &batch.transfer, 1, &timeline);
+        transferSubmit.setPNext(&transferTimeline);
+        transferQueue.submit(1, &transferSubmit, nullptr);
+
+        vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+        vk::TimelineSemaphoreSubmitInfo graphicsTimeline(1, &copied, 1, &batch.value);
+        vk::SubmitInfo graphicsSubmit(1, &timeline, &waitStage, 1, &batch.graphics, 1, &timeline);
+        graphicsSubmit.setPNext(&graphicsTimeline);
+        graphicsQueue.submit(1, &graphicsSubmit, nullptr);
+
+        inFlight.push_back(batch);
+        return batch.value;
+    }
+
+    uint64_t completed() {
+        return deviceRef.getSemaphoreCounterValue(timeline);
+    }
+
+    void wait(uint64_t value) {
+        vk::SemaphoreWaitInfo waitInfo({}, 1, &timeline, &value);
+        if (deviceRef.waitSemaphores(waitInfo, UINT64_MAX) != vk::Result::eSuccess) {
+            throw std::runtime_error("failed to wait for uploads!");
+        }
+    }
+
+    // frees the staging memory and command buffers of finished batches
+    void collect() {
+        uint64_t done = completed();
+        auto finished = std::partition(inFlight.begin(), inFlight.end(), [done](const Batch& batch) { return batch.value > done; });
+        for (auto it = finished; it != inFlight.end(); ++it) {
+            deviceRef.unmapMemory(it->stagingBufferMemory);
+            deviceRef.destroyBuffer(it->stagingBuffer);
+            deviceRef.freeMemory(it->stagingBufferMemory);
+            deviceRef.freeCommandBuffers(transferPool, 1, &it->transfer);
+            deviceRef.freeCommandBuffers(graphicsPool, 1, &it->graphics);
+        }
+        inFlight.erase(finished, inFlight.end());
+    }
+
+private:
+    vk::Device& deviceRef;
+    vk::PhysicalDevice physicalDevice;
+    uint32_t graphicsFamily;
+    vk::Queue graphicsQueue;
+    uint32_t transferFamily;
+    vk::Queue transferQueue;
+    vk::CommandPool transferPool;
+    vk::CommandPool graphicsPool;
+    uint64_t submitted = 0;
+    std::vector<Batch> inFlight;
+};
+
 class VulkanApp {
 public:
     void run() {
@@ -327,6 +747,9 @@ private:
     vk::Device device;
     vk::Queue graphicsQueue;
     vk::Queue presentQueue;
+    vk::Queue transferQueue; // graphicsQueue when there is no transfer-only family
+    uint32_t graphicsFamily;
+    uint32_t transferFamily;
     vk::Instance instance;
     vk::PhysicalDevice physicalDevice;
     vk::SurfaceKHR surface;
@@ -353,20 +776,47 @@ private:
     vk::DescriptorPool descriptorPool;
     Renderer* modelRenderer;
     Renderer* edgeRenderer;
+    MeshletCuller* meshletCuller = nullptr;
     std::vector<vk::DescriptorSet> descriptorSets;
-
-    std::vector<uint32_t> vertexCounts;
-    std::vector<Vertex> vertices;
-    std::vector<uint16_t> indices;
-    vk::Buffer vertexBuffer;
+    std::vector<vk::DescriptorSet> cullDescriptorSets;
+
+    std::optional<PMXCache::MeshSource> meshSource; // released once the buffers are uploaded
+    std::vector<Model::DrawRange> draws;
+    std::vector<Model::LodLevel> lods;
+    glm::vec4 modelBounds; // xyz: center, w: radius, from the quantization range
+    uint32_t currentLod = 0;
+    Model::VertexQuantization vertexQuantization;
+    vk::Buffer vertexBuffer; // position stream, then the attribute stream at attributeStreamOffset
     vk::DeviceMemory vertexBufferMemory;
+    vk::DeviceSize attributeStreamOffset;
     vk::Buffer indexBuffer;
     vk::DeviceMemory indexBufferMemory;
-    std::array<vk::Image, 8> textureImage;
-    std::array<uint32_t, 8> mipLevels;
-    std::array<vk::DeviceMemory, 8> textureImageMemory;
-    std::array<vk::ImageView, 8> textureImageView;
-    std::array<vk::Sampler, 8> textureSampler;
+    vk::IndexType indexType = vk::IndexType::eUint16;
+    // meshlet culling needs multiDrawIndirect and a compute capable graphics queue; without
+    // drawIndirectCount every meshlet keeps its command slot and culled ones draw zero indices
+    bool meshletCulling = false;
+    bool drawIndirectCount = false;
+    // textures load from block-compressed TextureCache files; without textureCompressionBC they are
+    // decoded and uploaded as rgba with mips blitted on the gpu
+    bool textureCompression = false;
+    uint32_t meshletCount = 0;
+    vk::Buffer meshletBuffer;
+    vk::DeviceMemory meshletBufferMemory;
+    std::vector<vk::Buffer> indirectBuffers; // per swapchain image: model pass commands, then edge pass commands
+    std::vector<vk::DeviceMemory> indirectBuffersMemory;
+    std::vector<vk::Buffer> drawCountBuffers; // per swapchain image: model pass counts, then edge pass counts
+    std::vector<vk::DeviceMemory> drawCountBuffersMemory;
+    uint32_t textureCapacity; // the most textures one descriptor set can hold
+    std::vector<vk::Image> textureImage;
+    std::vector<uint32_t> mipLevels;
+    std::vector<vk::DeviceMemory> textureImageMemory;
+    std::vector<vk::ImageView> textureImageView;
+    std::vector<vk::Sampler> textureSampler;
+    // bound in place of textures whose upload has not finished
+    vk::Image placeholderImage;
+    vk::DeviceMemory placeholderImageMemory;
+    vk::ImageView placeholderImageView;
+    vk::Sampler placeholderSampler;
     std::vector<vk::Buffer> uniformBuffers;
     std::vector<vk::DeviceMemory> uniformBuffersMemory;
 
@@ -376,6 +826,28 @@ private:
 
     std::vector<std::filesystem::path> texturePaths;
 
+    // streaming: uploads finish in the background, and a resource is drawn once the upload
+    // timeline reaches its value. before a swapchain image is next rendered, newly resident
+    // textures are written into its descriptor set, and its command buffers are re-recorded once
+    // the mesh lands.
+    Uploader* uploader = nullptr;
+    TextureDecoder* textureDecoder = nullptr; // deleted once every texture has been staged
+    size_t texturesStaged = 0;
+    uint64_t meshReady = 0;
+    bool meshResident = false;
+    std::vector<uint64_t> textureReady; // 0 until submitted
+    std::vector<bool> textureResident;
+    std::vector<std::chrono::high_resolution_clock::time_point> textureSubmitted;
+    std::chrono::high_resolution_clock::time_point streamStart;
+    uint64_t residentValue = 0; // the highest value among resident resources; every frame waits for it
+    std::vector<size_t> residentTextures; // in the order they became resident
+    std::vector<size_t> boundTextures;    // per image: how many of residentTextures its set holds
+    std::vector<bool> recordedMesh;       // per image: whether its command buffers draw the mesh
+    std::vector<bool> textureSrgbGray;    // bc4 textures, known once staged; set before they are resident,
+                                          // which is harmless as the white placeholder linearizes to itself
+    size_t srgbGrayTextures = 0;
+    std::vector<size_t> recordedSrgbGray; // per image: srgbGrayTextures when its command buffers were recorded
+
     void initWindow() {
         glfwInit();
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
@@ -419,8 +891,8 @@ private:
 
         createRenderPass();
 
-        modelRenderer = new Renderer(device, swapChainDetails, renderPass, MODEL_VERTEX_SHADER_PATH, FRAGMENT_SHADER_PATH, vk::CullModeFlagBits::eBack);
-        edgeRenderer = new Renderer(device, swapChainDetails, renderPass, EDGE_VERTEX_SHADER_PATH, FRAGMENT_SHADER_PATH, vk::CullModeFlagBits::eFront);
+        modelRenderer = new Renderer(device, swapChainDetails, renderPass, textureCapacity, MODEL_VERTEX_SHADER_PATH, FRAGMENT_SHADER_PATH, vk::CullModeFlagBits::eBack);
+        edgeRenderer = new Renderer(device, swapChainDetails, renderPass, textureCapacity, EDGE_VERTEX_SHADER_PATH, FRAGMENT_SHADER_PATH, vk::CullModeFlagBits::eFront, true);
 
         // createDescriptorSetLayout();
 
@@ -429,26 +901,37 @@ private:
 
         createCommandPool();
 
+        uploader = new Uploader(device, physicalDevice, graphicsFamily, graphicsQueue, transferFamily, transferQueue);
+
         createDepthResources();
 
         createFramebuffers();
 
         loadModel();
 
-        createTextureImage();
+        // decodes run while the rest of the setup and the first frames do
+        textureDecoder = new TextureDecoder(texturePaths, textureCompression);
 
-        createTextureSampler();
+        createPlaceholderTexture();
 
-        createVertexBuffer();
+        createMeshBuffers();
 
-        createIndexBuffer();
+        meshSource.reset();
+
+        if (meshletCulling) {
+            meshletCuller = new MeshletCuller(device, CULL_COMPUTE_SHADER_PATH);
+        }
 
         createUniformBuffers();
 
+        createIndirectBuffers();
+
         createDescriptorPool();
 
         createDescriptorSets();
 
+        createCullDescriptorSets();
+
         createCommandBuffers();
 
         createSyncObjects();
@@ -509,10 +992,13 @@ private:
 
     void createLogicalDevice() {
         auto indices = vklearn::findQueueFamilies(physicalDevice, surface);
+        graphicsFamily = indices.graphicsFamily.value();
+        transferFamily = indices.transferFamily.value_or(graphicsFamily);
         std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
         std::set<uint32_t> uniqueQueueFamilies = {
             indices.graphicsFamily.value(),
             indices.presentFamily.value(),
+            transferFamily,
         };
 
         float queuePriority = 1.0f;
@@ -526,8 +1012,37 @@ private:
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
+        auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+        bool graphicsCompute = static_cast<bool>(queueFamilies[indices.graphicsFamily.value()].queueFlags & vk::QueueFlagBits::eCompute);
+        meshletCulling = physicalDevice.getFeatures().multiDrawIndirect && graphicsCompute;
+
+        vk::PhysicalDeviceVulkan12Features vulkan12Features{};
+        auto supported = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+        drawIndirectCount = meshletCulling && supported.get<vk::PhysicalDeviceVulkan12Features>().drawIndirectCount;
+        vulkan12Features.setDrawIndirectCount(drawIndirectCount);
+        vulkan12Features.setTimelineSemaphore(true); // required by 1.2, checked in rateDeviceSuitability
+        // bindless textures; checked in rateDeviceSuitability
+        vulkan12Features
+            .setRuntimeDescriptorArray(true)
+            .setShaderSampledImageArrayNonUniformIndexing(true)
+            .setDescriptorBindingPartiallyBound(true)
+            .setDescriptorBindingVariableDescriptorCount(true)
+            .setDescriptorBindingSampledImageUpdateAfterBind(true);
+
+        auto limits = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>().get<vk::PhysicalDeviceVulkan12Properties>();
+        textureCapacity = std::min({
+            limits.maxPerStageDescriptorUpdateAfterBindSamplers,
+            limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            limits.maxDescriptorSetUpdateAfterBindSamplers,
+            limits.maxDescriptorSetUpdateAfterBindSampledImages,
+            limits.maxPerStageUpdateAfterBindResources - 1, // the ubo
+        });
+
         vk::PhysicalDeviceFeatures deviceFeatures{};
         deviceFeatures.setSamplerAnisotropy(true);
+        deviceFeatures.setMultiDrawIndirect(meshletCulling);
+        textureCompression = physicalDevice.getFeatures().textureCompressionBC;
+        deviceFeatures.setTextureCompressionBC(textureCompression);
 
         vk::DeviceCreateInfo createInfo(
             {},
@@ -543,11 +1058,15 @@ private:
             createInfo.enabledLayerCount = static_cast<uint32_t>(vklearn::validationLayers.size());
             createInfo.ppEnabledLayerNames = vklearn::validationLayers.data();
         }
-        // for compatibility with older implementations
+        createInfo.pNext = &vulkan12Features;
 
         device = physicalDevice.createDevice(createInfo);
         graphicsQueue = device.getQueue(indices.graphicsFamily.value(), 0);
         presentQueue = device.getQueue(indices.presentFamily.value(), 0);
+        transferQueue = device.getQueue(transferFamily, 0);
+        std::cout << "texture capacity " << textureCapacity << (textureCompression ? ", bc compressed" : ", rgba8 (no bc support)") << std::endl;
+        std::cout << "uploads on queue family " << transferFamily
+                  << (transferFamily != graphicsFamily ? " (transfer only)" : " (graphics)") << std::endl;
     }
 
     void createSwapChain() {
@@ -666,8 +1185,9 @@ private:
 
     void createCommandPool() {
         vklearn::QueueFamilyIndices queueFamilyIndices = vklearn::findQueueFamilies(physicalDevice, surface);
+        // command buffers are re-recorded whenever newly streamed resources become resident
         vk::CommandPoolCreateInfo poolInfo(
-            {},
+            vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
             queueFamilyIndices.graphicsFamily.value());
         if (device.createCommandPool(&poolInfo, nullptr, &commandPool) != vk::Result::eSuccess) {
             throw std::runtime_error("failed to create command pool!");
@@ -702,15 +1222,9 @@ private:
             1);
     }
 
-    void generateMipmaps(vk::Image image, vk::Format imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
-        vk::CommandBuffer commandBuffer = vklearn::beginSingleTimeCommands(device, commandPool);
-
-        // check if image format supports linear blitting
-        vk::FormatProperties formatProperties = physicalDevice.getFormatProperties(imageFormat);
-        if (!(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear)) {
-            throw std::runtime_error("texture image format does not support linear blitting!");
-        }
-
+    // records the blits for every level below 0 and leaves all of them in eShaderReadOnlyOptimal.
+    // the caller checks that the format supports linear blitting.
+    void generateMipmaps(vk::CommandBuffer commandBuffer, vk::Image image, int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
         vk::ImageMemoryBarrier barrier;
         barrier
             .setImage(image)
@@ -788,104 +1302,214 @@ private:
             0, nullptr,
             1, &barrier
         );
+    }
 
-        vklearn::endSingleTimeCommands(device, commandPool, commandBuffer, graphicsQueue);
+    // a 1x1 white texture, uploaded before the first frame, stands in for textures still streaming in
+    void createPlaceholderTexture() {
+        vk::FormatProperties formatProperties = physicalDevice.getFormatProperties(vk::Format::eR8G8B8A8Srgb);
+        if (!(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear)) {
+            throw std::runtime_error("texture image format does not support linear blitting!");
+        }
+
+        createImage(
+            1, 1, 1,
+            vk::Format::eR8G8B8A8Srgb,
+            vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            placeholderImage,
+            placeholderImageMemory
+            );
+        Uploader::Batch batch = uploader->begin(4);
+        std::fill(batch.staging, batch.staging + 4, 0xFF);
+        uploader->copyImage(batch, 0, placeholderImage, 1, 1, 1);
+        generateMipmaps(batch.graphics, placeholderImage, 1, 1, 1);
+        uploader->wait(uploader->submit(batch));
+
+        placeholderImageView = vklearn::boilerplate::createImageView(device, placeholderImage, vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor, 1);
+        placeholderSampler = createTextureSampler(1);
+        streamStart = std::chrono::high_resolution_clock::now();
     }
 
-    void createTextureImage() {
-        for (int j=0; j < texturePaths.size(); ++j) {
-            int texWidth, texHeight, texChannels;
-            stbi_uc* pixels = stbi_load(texturePaths[j].c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-            vk::DeviceSize imageSize = texWidth * texHeight * 4;
-            mipLevels[j] = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+    // stages every texture decoded since the last call into one upload batch; called once per frame.
+    // a texture that fails to decode keeps the placeholder.
+    void streamTextures() {
+        if (!textureDecoder) {
+            return;
+        }
+        std::vector<TextureDecoder::Texture> decoded;
+        TextureDecoder::Texture texture;
+        vk::DeviceSize stagingSize = 0;
+        while (textureDecoder->poll(texture)) {
+            texturesStaged++;
+            if (!texture.pixels && !texture.compressed) {
+                std::cerr << "failed to load texture image " << texturePaths[texture.index].string() << ": " << texture.error << std::endl;
+                continue;
+            }
+            stagingSize += (stagingSizeOf(texture) + 15) & ~vk::DeviceSize(15);
+            decoded.push_back(std::move(texture));
+        }
+        if (texturesStaged == texturePaths.size()) {
+            delete textureDecoder;
+            textureDecoder = nullptr;
+        }
+        if (decoded.empty()) {
+            return;
+        }
 
-            if (!pixels) {
-                throw std::runtime_error("failed to load texture image!");
+        Uploader::Batch batch = uploader->begin(stagingSize);
+        vk::DeviceSize stagingOffset = 0;
+        for (auto& t : decoded) {
+            auto stageStart = std::chrono::high_resolution_clock::now();
+            vk::DeviceSize imageSize = stagingSizeOf(t);
+            if (t.compressed) {
+                // the level data is already laid out for the copy: one memcpy from the mapped file
+                memcpy(batch.staging + stagingOffset, t.compressed->data() + t.compressed->data_offset, static_cast<size_t>(imageSize));
+                recordCompressedTextureUpload(batch, t.index, stagingOffset, *t.compressed);
+            } else {
+                memcpy(batch.staging + stagingOffset, t.pixels, static_cast<size_t>(imageSize));
+                stbi_image_free(t.pixels);
+                recordTextureUpload(batch, t.index, stagingOffset, t.width, t.height);
+            }
+            stagingOffset += (imageSize + 15) & ~vk::DeviceSize(15);
+            auto stageEnd = std::chrono::high_resolution_clock::now();
+
+            std::cout << "texture " << t.index << " " << texturePaths[t.index].filename().string() << ": " << t.width << "x" << t.height;
+            if (t.compressed) {
+                std::cout << " " << TextureCache::format_name(t.compressed->format) << ", " << imageSize / 1024 << "KiB, "
+                          << (t.compressed->from_cache ? "cached " : "encode ") << t.decodeMs << "ms";
+            } else {
+                std::cout << ", decode " << t.decodeMs << "ms";
             }
+            std::cout << ", stage " << std::chrono::duration<double, std::milli>(stageEnd - stageStart).count() << "ms" << std::endl;
+        }
+        uint64_t value = uploader->submit(batch);
+        auto submitTime = std::chrono::high_resolution_clock::now();
+        for (const auto& t : decoded) {
+            textureReady[t.index] = value;
+            textureSubmitted[t.index] = submitTime;
+        }
+    }
 
-            vk::Buffer stagingBuffer;
-            vk::DeviceMemory stagingBufferMemory;
-            std::tie(stagingBuffer, stagingBufferMemory) = vklearn::createBuffer(
-                physicalDevice, device,
-                imageSize, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
-            );
+    vk::DeviceSize stagingSizeOf(const TextureDecoder::Texture& texture) {
+        if (texture.compressed) {
+            return texture.compressed->data_size;
+        }
+        return static_cast<vk::DeviceSize>(texture.width) * texture.height * 4;
+    }
 
-            void* data;
-            device.mapMemory(stagingBufferMemory, 0, imageSize, {}, &data);
-            memcpy(data, pixels, static_cast<size_t>(imageSize));
-            device.unmapMemory(stagingBufferMemory);
-
-            stbi_image_free(pixels);
-
-            createImage(
-                texWidth, texHeight, mipLevels[j],
-                vk::Format::eR8G8B8A8Srgb,
-                vk::ImageTiling::eOptimal,
-                vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-                vk::MemoryPropertyFlagBits::eDeviceLocal,
-                textureImage[j],
-                textureImageMemory[j]
-                );
-            
-            vklearn::transitionImageLayout(
-                device, commandPool, graphicsQueue,
-                textureImage[j],
-                vk::Format::eR8G8B8A8Srgb,
-                vk::ImageLayout::eUndefined,
-                vk::ImageLayout::eTransferDstOptimal,
-                mipLevels[j]);
-            vklearn::copyBufferToImage(
-                device, commandPool, graphicsQueue,
-                stagingBuffer,
-                textureImage[j],
-                static_cast<uint32_t>(texWidth),
-                static_cast<uint32_t>(texHeight)
+    // creates texture j from a TextureCache file staged as-is at stagingOffset; the mips come with it
+    void recordCompressedTextureUpload(Uploader::Batch& batch, size_t j, vk::DeviceSize stagingOffset, const TextureCache::Texture& texture) {
+        vk::Format format = static_cast<vk::Format>(texture.format);
+        mipLevels[j] = static_cast<uint32_t>(texture.levels.size());
+
+        createImage(
+            texture.width, texture.height, mipLevels[j],
+            format,
+            vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            textureImage[j],
+            textureImageMemory[j]
             );
 
-            device.destroyBuffer(stagingBuffer);
-            device.freeMemory(stagingBufferMemory);
+        std::vector<vk::BufferImageCopy> regions;
+        for (uint32_t level = 0; level < mipLevels[j]; ++level) {
+            const TextureCache::Level& l = texture.levels[level];
+            regions.push_back(vk::BufferImageCopy(
+                stagingOffset + (l.offset - texture.data_offset), 0, 0,
+                vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level, 0, 1),
+                vk::Offset3D{0, 0, 0},
+                vk::Extent3D{l.width, l.height, 1}));
+        }
+        uploader->copyImageLevels(batch, textureImage[j], regions, mipLevels[j]);
+        if (texture.format == TextureCache::FORMAT_BC4_UNORM) {
+            textureSrgbGray[j] = true;
+            srgbGrayTextures++;
+        }
+
+        textureImageView[j] = vklearn::boilerplate::createImageView(device, textureImage[j], format, vk::ImageAspectFlagBits::eColor, mipLevels[j]);
+        textureSampler[j] = createTextureSampler(mipLevels[j]);
+    }
 
-            generateMipmaps(textureImage[j], vk::Format::eR8G8B8A8Srgb, texWidth, texHeight, mipLevels[j]);
+    // creates texture j and records its copy from the staging buffer and its mip chain
+    void recordTextureUpload(Uploader::Batch& batch, size_t j, vk::DeviceSize stagingOffset, int texWidth, int texHeight) {
+        mipLevels[j] = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 
-            vklearn::transitionImageLayout(
-                device, commandPool, graphicsQueue,
-                textureImage[j],
-                vk::Format::eR8G8B8A8Srgb,
-                vk::ImageLayout::eTransferDstOptimal,
-                vk::ImageLayout::eShaderReadOnlyOptimal,
-                mipLevels[j]
+        createImage(
+            texWidth, texHeight, mipLevels[j],
+            vk::Format::eR8G8B8A8Srgb,
+            vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            textureImage[j],
+            textureImageMemory[j]
             );
 
+        uploader->copyImage(batch, stagingOffset, textureImage[j], static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), mipLevels[j]);
+        generateMipmaps(batch.graphics, textureImage[j], texWidth, texHeight, mipLevels[j]);
 
+        textureImageView[j] = vklearn::boilerplate::createImageView(device, textureImage[j], vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor, mipLevels[j]);
+        textureSampler[j] = createTextureSampler(mipLevels[j]);
+    }
 
-            textureImageView[j] = vklearn::boilerplate::createImageView(device, textureImage[j], vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor, mipLevels[j]);
+    // marks resources whose upload the timeline has passed as resident
+    void updateResidency() {
+        uploader->collect();
+        uint64_t completed = uploader->completed();
+        auto now = std::chrono::high_resolution_clock::now();
+        size_t before = residentTextures.size();
+        if (!meshResident && meshReady <= completed) {
+            meshResident = true;
+            residentValue = std::max(residentValue, meshReady);
+            std::cout << "mesh resident after " << std::chrono::duration<double, std::milli>(now - streamStart).count() << "ms" << std::endl;
+        }
+        size_t pending = 0;
+        for (size_t j = 0; j < texturePaths.size(); ++j) {
+            if (textureResident[j] || textureReady[j] == 0) {
+                continue;
+            }
+            if (textureReady[j] > completed) {
+                pending++;
+                continue;
+            }
+            textureResident[j] = true;
+            residentTextures.push_back(j);
+            residentValue = std::max(residentValue, textureReady[j]);
+            // observed at frame granularity, so this is an upper bound
+            std::cout << "texture " << j << " resident, upload "
+                      << std::chrono::duration<double, std::milli>(now - textureSubmitted[j]).count() << "ms" << std::endl;
+        }
+        // once the decoder is gone every texture has been submitted or has failed
+        if (residentTextures.size() != before && !textureDecoder && pending == 0) {
+            std::cout << "textures streamed in " << std::chrono::duration<double, std::milli>(now - streamStart).count() << "ms" << std::endl;
         }
     }
 
-    void createTextureSampler() {
-        for (int j=0; j < texturePaths.size(); ++j) {
-            vk::SamplerCreateInfo samplerInfo{};
-            samplerInfo
-                .setMagFilter(vk::Filter::eLinear)
-                .setMinFilter(vk::Filter::eLinear)
-                .setAddressModeU(vk::SamplerAddressMode::eRepeat)
-                .setAddressModeV(vk::SamplerAddressMode::eRepeat)
-                .setAddressModeW(vk::SamplerAddressMode::eRepeat)
-                .setAnisotropyEnable(true)
-                .setMaxAnisotropy(16.0f)
-                .setBorderColor(vk::BorderColor::eIntOpaqueBlack)
-                .setUnnormalizedCoordinates(false)
-                .setCompareEnable(false)
-                .setCompareOp(vk::CompareOp::eAlways)
-                .setMipmapMode(vk::SamplerMipmapMode::eLinear)
-                .setMipLodBias(0.0f)
-                .setMinLod(0.0f)
-                .setMaxLod(static_cast<float>(mipLevels[j]));
-
-            if (device.createSampler(&samplerInfo, nullptr, &textureSampler[j]) != vk::Result::eSuccess) {
-                throw std::runtime_error("failed to create texture sampler!");
-            }
+    vk::Sampler createTextureSampler(uint32_t mipLevels) {
+        vk::SamplerCreateInfo samplerInfo{};
+        samplerInfo
+            .setMagFilter(vk::Filter::eLinear)
+            .setMinFilter(vk::Filter::eLinear)
+            .setAddressModeU(vk::SamplerAddressMode::eRepeat)
+            .setAddressModeV(vk::SamplerAddressMode::eRepeat)
+            .setAddressModeW(vk::SamplerAddressMode::eRepeat)
+            .setAnisotropyEnable(true)
+            .setMaxAnisotropy(16.0f)
+            .setBorderColor(vk::BorderColor::eIntOpaqueBlack)
+            .setUnnormalizedCoordinates(false)
+            .setCompareEnable(false)
+            .setCompareOp(vk::CompareOp::eAlways)
+            .setMipmapMode(vk::SamplerMipmapMode::eLinear)
+            .setMipLodBias(0.0f)
+            .setMinLod(0.0f)
+            .setMaxLod(static_cast<float>(mipLevels));
+
+        vk::Sampler sampler;
+        if (device.createSampler(&samplerInfo, nullptr, &sampler) != vk::Result::eSuccess) {
+            throw std::runtime_error("failed to create texture sampler!");
         }
+        return sampler;
     }
 
     void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Image& image, vk::DeviceMemory& imageMemory) {
@@ -930,66 +1554,72 @@ private:
     }
 
     void loadModel() {
-        std::vector<PMXLoader::Vertex> _vertices;
-        std::vector<int> _planes;
-        std::vector<PMXLoader::Material> _materials;
-        std::tie(_vertices, _planes, texturePaths, _materials) = PMXLoader::read_pmx(PMX_PATH);
-
-        vertices = std::vector<Vertex>(_vertices.size());
-        for (int j=0; j < _vertices.size(); ++j) {
-            auto _pos = _vertices[j].position;
-            auto _norm = _vertices[j].normal;
-            auto _uv = _vertices[j].uv;
-            vertices[j] = {
-                glm::vec3(_pos.x, _pos.y, _pos.z),
-                glm::vec3(_norm.x, _norm.y, _norm.z),
-                glm::vec2(_uv.x, _uv.y),
-                0
-            };
+        auto startTime = std::chrono::high_resolution_clock::now();
+        meshSource.emplace(PMXCache::load(PMX_PATH));
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        const Model::MeshView& mesh = meshSource->view;
+        texturePaths = meshSource->textures;
+        if (texturePaths.size() + 1 > textureCapacity) {
+            throw std::runtime_error("model has " + std::to_string(texturePaths.size()) + " textures, more than the " + std::to_string(textureCapacity - 1) + " a descriptor set can hold besides the untextured slot");
         }
-
-        std::cout << _vertices.size() << "(" << _planes.size() << ")" << std::endl;
-        int cur = 0;
-        for (int j=0; j < _materials.size(); ++j) {
-            vertexCounts.push_back(_materials[j].number_of_plane);
-            std::cout << _materials[j].name << " " << _materials[j].number_of_plane / 3 << std::endl;
-            for (int k=0; k < _materials[j].number_of_plane / 3; ++k) {
-                vertices[cur].texID = _materials[j].normal_texture;
-                cur++;
+        textureImage.resize(texturePaths.size());
+        mipLevels.resize(texturePaths.size());
+        textureImageMemory.resize(texturePaths.size());
+        textureImageView.resize(texturePaths.size());
+        textureSampler.resize(texturePaths.size());
+        textureReady.assign(texturePaths.size(), 0);
+        textureResident.assign(texturePaths.size(), false);
+        textureSrgbGray.assign(texturePaths.size(), false);
+        textureSubmitted.resize(texturePaths.size());
+        draws.assign(mesh.draws, mesh.draws + mesh.draw_count);
+        vertexQuantization = mesh.quantization;
+        indexType = mesh.index_size == 2 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+        lods.assign(mesh.lods, mesh.lods + mesh.lod_count);
+        glm::vec3 boundsMin = glm::vec3(vertexQuantization.bias);
+        glm::vec3 boundsMax = boundsMin + glm::vec3(vertexQuantization.scale) * 65535.0f;
+        modelBounds = glm::vec4((boundsMin + boundsMax) * 0.5f, glm::length(boundsMax - boundsMin) * 0.5f);
+        meshletCount = static_cast<uint32_t>(mesh.meshlet_count);
+        meshletCulling = meshletCulling && meshletCount > 0;
+        drawIndirectCount = drawIndirectCount && meshletCulling;
+
+        std::cout << mesh.vertex_count << "(" << mesh.index_count << ")"
+                  << (meshSource->from_cache ? " from cache" : "") << " in "
+                  << std::chrono::duration<double, std::milli>(endTime - startTime).count() << "ms" << std::endl;
+        std::cout << "indices: " << mesh.index_count << " x " << mesh.index_size << " bytes = "
+                  << Model::index_bytes(mesh) / 1024.0 << " KB" << std::endl;
+        std::cout << "meshlets: " << meshletCount << ", culling "
+                  << (!meshletCulling ? "off" : drawIndirectCount ? "on (drawIndexedIndirectCount)" : "on (drawIndexedIndirect)") << std::endl;
+        for (uint32_t lod = 0; lod < lods.size(); ++lod) {
+            std::cout << "lod " << lod << " (error " << lods[lod].error << "):" << std::endl;
+            for (uint32_t j = lods[lod].firstDraw; j < lods[lod].firstDraw + lods[lod].drawCount; ++j) {
+                std::cout << "material " << draws[j].material << " " << draws[j].indexCount / 3 << " in " << draws[j].meshletCount << " meshlets" << std::endl;
             }
         }
-        std::cout << cur << " ok" << std::endl;
-
-        indices = std::vector<uint16_t>(_planes.size());
-        for (int j=0; j < _planes.size(); ++j) {
-            indices[j] = static_cast<uint16_t>(_planes[j]);
-        }
-
-        // vertices = {
-        //     {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
-        //     {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
-        //     {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
-        //     {{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}}
-        // };
-        // indices = {
-        //     0, 1, 2, 2, 3, 0
-        // };
     }
 
-    void createVertexBuffer() {
-        vk::DeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-        vk::Buffer stagingBuffer;
-        vk::DeviceMemory stagingBufferMemory;
-        std::tie(stagingBuffer, stagingBufferMemory) = vklearn::createBuffer(
-            physicalDevice, device, bufferSize,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
-            );
+    // stages the vertex, index and meshlet buffers into one upload batch; the model is drawn once it lands
+    void createMeshBuffers() {
+        const Model::MeshView& mesh = meshSource->view;
+        vk::DeviceSize positionSize = sizeof(Model::PackedPosition) * mesh.vertex_count;
+        attributeStreamOffset = (positionSize + 15) & ~vk::DeviceSize(15);
+        vk::DeviceSize vertexSize = attributeStreamOffset + sizeof(Model::PackedAttributes) * mesh.vertex_count;
+        vk::DeviceSize indexOffset = (vertexSize + 15) & ~vk::DeviceSize(15);
+        vk::DeviceSize indexSize = Model::index_bytes(mesh);
+        vk::DeviceSize meshletOffset = (indexOffset + indexSize + 15) & ~vk::DeviceSize(15);
+        vk::DeviceSize meshletSize = meshletCulling ? sizeof(Model::Meshlet) * meshletCount : 0;
+
+        Uploader::Batch batch = uploader->begin(meshletOffset + meshletSize);
+        createVertexBuffer(batch, 0, vertexSize);
+        createIndexBuffer(batch, indexOffset, indexSize);
+        createMeshletBuffer(batch, meshletOffset, meshletSize);
+        meshReady = uploader->submit(batch);
+    }
 
-        void* data;
-        device.mapMemory(stagingBufferMemory, 0, bufferSize, {}, &data);
-        memcpy(data, vertices.data(), (size_t) bufferSize);
-        device.unmapMemory(stagingBufferMemory);
+    void createVertexBuffer(Uploader::Batch& batch, vk::DeviceSize stagingOffset, vk::DeviceSize bufferSize) {
+        const Model::MeshView& mesh = meshSource->view;
+        memcpy(batch.staging + stagingOffset, mesh.positions, sizeof(Model::PackedPosition) * mesh.vertex_count);
+        memcpy(batch.staging + stagingOffset + attributeStreamOffset, mesh.attributes, sizeof(Model::PackedAttributes) * mesh.vertex_count);
 
         std::tie(vertexBuffer, vertexBufferMemory) = vklearn::createBuffer(
             physicalDevice, device, bufferSize,
@@ -997,26 +1627,11 @@ private:
             vk::MemoryPropertyFlagBits::eDeviceLocal
             );
 
-        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-
-        device.destroyBuffer(stagingBuffer);
-        device.freeMemory(stagingBufferMemory);
+        uploader->copyBuffer(batch, stagingOffset, vertexBuffer, bufferSize, vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eVertexAttributeRead);
     }
 
-    void createIndexBuffer() {
-        vk::DeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-        vk::Buffer stagingBuffer;
-        vk::DeviceMemory stagingBufferMemory;
-        std::tie(stagingBuffer, stagingBufferMemory) = vklearn::createBuffer(
-            physicalDevice, device, bufferSize,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
-            );
-        
-        void* data;
-        device.mapMemory(stagingBufferMemory, 0, bufferSize, {}, &data);
-        memcpy(data, indices.data(), (size_t) bufferSize);
-        device.unmapMemory(stagingBufferMemory);
+    void createIndexBuffer(Uploader::Batch& batch, vk::DeviceSize stagingOffset, vk::DeviceSize bufferSize) {
+        memcpy(batch.staging + stagingOffset, meshSource->view.indices, (size_t) bufferSize);
 
         std::tie(indexBuffer, indexBufferMemory) = vklearn::createBuffer(
             physicalDevice, device, bufferSize,
@@ -1024,10 +1639,49 @@ private:
             vk::MemoryPropertyFlagBits::eDeviceLocal
         );
 
-        copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+        uploader->copyBuffer(batch, stagingOffset, indexBuffer, bufferSize, vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eIndexRead);
+    }
+
+    void createMeshletBuffer(Uploader::Batch& batch, vk::DeviceSize stagingOffset, vk::DeviceSize bufferSize) {
+        if (!meshletCulling) {
+            return;
+        }
+        memcpy(batch.staging + stagingOffset, meshSource->view.meshlets, (size_t) bufferSize);
+
+        std::tie(meshletBuffer, meshletBufferMemory) = vklearn::createBuffer(
+            physicalDevice, device, bufferSize,
+            vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        );
+
+        uploader->copyBuffer(batch, stagingOffset, meshletBuffer, bufferSize, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead);
+    }
+
+    // written by cull_meshlets.comp, one set per swapchain image like the uniform buffers
+    void createIndirectBuffers() {
+        if (!meshletCulling) {
+            return;
+        }
+        vk::DeviceSize commandSize = 2 * sizeof(vk::DrawIndexedIndirectCommand) * meshletCount;
+        vk::DeviceSize countSize = 2 * sizeof(uint32_t) * draws.size();
+
+        indirectBuffers.resize(swapChainImages.size());
+        indirectBuffersMemory.resize(swapChainImages.size());
+        drawCountBuffers.resize(swapChainImages.size());
+        drawCountBuffersMemory.resize(swapChainImages.size());
 
-        device.destroyBuffer(stagingBuffer);
-        device.freeMemory(stagingBufferMemory);
+        for (size_t i = 0; i < swapChainImages.size(); ++i) {
+            std::tie(indirectBuffers[i], indirectBuffersMemory[i]) = vklearn::createBuffer(
+                physicalDevice, device, commandSize,
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+                vk::MemoryPropertyFlagBits::eDeviceLocal
+            );
+            std::tie(drawCountBuffers[i], drawCountBuffersMemory[i]) = vklearn::createBuffer(
+                physicalDevice, device, countSize,
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                vk::MemoryPropertyFlagBits::eDeviceLocal
+            );
+        }
     }
 
     void createUniformBuffers() {
@@ -1047,17 +1701,22 @@ private:
     }
 
     void createDescriptorPool() {
-        std::array<vk::DescriptorPoolSize, 2> poolSizes{};
+        // the culling sets take one more ubo and three storage buffers per image
+        uint32_t setsPerImage = meshletCulling ? 2 : 1;
+        std::array<vk::DescriptorPoolSize, 3> poolSizes{};
         poolSizes[0]
             .setType(vk::DescriptorType::eUniformBuffer)
-            .setDescriptorCount(static_cast<uint32_t>(swapChainImages.size()));
+            .setDescriptorCount(static_cast<uint32_t>(swapChainImages.size()) * setsPerImage);
         poolSizes[1]
             .setType(vk::DescriptorType::eCombinedImageSampler)
-            .setDescriptorCount(static_cast<uint32_t>(swapChainImages.size()));
+            .setDescriptorCount(static_cast<uint32_t>(swapChainImages.size()) * textureSlots());
+        poolSizes[2]
+            .setType(vk::DescriptorType::eStorageBuffer)
+            .setDescriptorCount(static_cast<uint32_t>(swapChainImages.size()) * 3);
         
         vk::DescriptorPoolCreateInfo poolInfo(
-            {},
-            static_cast<uint32_t>(swapChainImages.size()), // max num of descriptor sets
+            vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+            static_cast<uint32_t>(swapChainImages.size()) * setsPerImage, // max num of descriptor sets
             static_cast<uint32_t>(poolSizes.size()),
             poolSizes.data()
         );
@@ -1067,67 +1726,217 @@ private:
         }
     }
 
+    // one slot per texture, then the slot draws without a texture sample; it always holds the white placeholder
+    uint32_t textureSlots() const {
+        return static_cast<uint32_t>(texturePaths.size()) + 1;
+    }
+
+    uint32_t textureSlot(int32_t texture) const {
+        return texture < 0 ? static_cast<uint32_t>(texturePaths.size()) : static_cast<uint32_t>(texture);
+    }
+
     void createDescriptorSets() {
         std::vector<vk::DescriptorSetLayout> layouts(swapChainImages.size(), modelRenderer->descriptorSetLayout);
+        std::vector<uint32_t> textureCounts(swapChainImages.size(), textureSlots());
+        vk::DescriptorSetVariableDescriptorCountAllocateInfo countInfo(
+            static_cast<uint32_t>(textureCounts.size()),
+            textureCounts.data()
+        );
         vk::DescriptorSetAllocateInfo allocInfo(
             descriptorPool,
             static_cast<uint32_t>(swapChainImages.size()),
             layouts.data()
         );
+        allocInfo.setPNext(&countInfo);
         descriptorSets.resize(swapChainImages.size());
 
         if (device.allocateDescriptorSets(&allocInfo, descriptorSets.data()) != vk::Result::eSuccess) {
             throw std::runtime_error("failed to allocate descriptor sets!");
         }
 
+        boundTextures.assign(swapChainImages.size(), 0);
         for (size_t idx = 0; idx < swapChainImages.size(); ++idx) {
-            vk::DescriptorBufferInfo bufferInfo(
-                uniformBuffers[idx],
-                0,
-                sizeof(UniformBufferObject)
-            );
-            std::array<vk::DescriptorImageInfo, 8> imageInfos{};
-            for (int j=0; j < 8; ++j) {
-                imageInfos[j] = vk::DescriptorImageInfo(
-                    textureSampler[j],
-                    textureImageView[j],
-                    vk::ImageLayout::eShaderReadOnlyOptimal
-                );
-            }
+            writeDescriptorSet(idx);
+        }
+    }
 
-            std::array<vk::WriteDescriptorSet, 2> descriptorWrites{};
-            descriptorWrites[0]
+    // written once per set: the ubo, and every slot a draw samples. slots of textures still
+    // streaming in hold the placeholder until bindResidentTextures replaces them; being partially
+    // bound, slots no draw samples are left empty.
+    void writeDescriptorSet(size_t idx) {
+        vk::DescriptorBufferInfo bufferInfo(
+            uniformBuffers[idx],
+            0,
+            sizeof(UniformBufferObject)
+        );
+        std::vector<bool> sampled(textureSlots(), false);
+        for (const auto& draw : draws) {
+            uint32_t slot = textureSlot(draw.texture);
+            if (slot < sampled.size()) {
+                sampled[slot] = true;
+            }
+        }
+        std::vector<vk::DescriptorImageInfo> imageInfos(textureSlots());
+        std::vector<vk::WriteDescriptorSet> descriptorWrites;
+        descriptorWrites.push_back(vk::WriteDescriptorSet()
+            .setDstSet(descriptorSets[idx])
+            .setDstBinding(0)
+            .setDstArrayElement(0)
+            .setDescriptorType(vk::DescriptorType::eUniformBuffer)
+            .setDescriptorCount(1)
+            .setPBufferInfo(&bufferInfo));
+        for (uint32_t j = 0; j < textureSlots(); ++j) {
+            bool resident = j < texturePaths.size() && textureResident[j];
+            if (!sampled[j] && !resident) {
+                continue;
+            }
+            imageInfos[j] = vk::DescriptorImageInfo(
+                resident ? textureSampler[j] : placeholderSampler,
+                resident ? textureImageView[j] : placeholderImageView,
+                vk::ImageLayout::eShaderReadOnlyOptimal
+            );
+            descriptorWrites.push_back(vk::WriteDescriptorSet()
                 .setDstSet(descriptorSets[idx])
-                .setDstBinding(0)
-                .setDstArrayElement(0)
-                .setDescriptorType(vk::DescriptorType::eUniformBuffer)
+                .setDstBinding(1)
+                .setDstArrayElement(j)
+                .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
                 .setDescriptorCount(1)
-                .setPBufferInfo(&bufferInfo);
-            descriptorWrites[1]
+                .setPImageInfo(&imageInfos[j]));
+        }
+
+        device.updateDescriptorSets(static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        boundTextures[idx] = residentTextures.size();
+    }
+
+    // appends the textures that became resident since this image's set was last written. the
+    // binding is update-after-bind, so its recorded command buffers stay valid; the caller has
+    // waited for the image's previous frame, so no pending submission reads the old slots.
+    void bindResidentTextures(size_t idx) {
+        size_t count = residentTextures.size() - boundTextures[idx];
+        if (count == 0) {
+            return;
+        }
+        std::vector<vk::DescriptorImageInfo> imageInfos(count);
+        std::vector<vk::WriteDescriptorSet> descriptorWrites(count);
+        for (size_t k = 0; k < count; ++k) {
+            size_t j = residentTextures[boundTextures[idx] + k];
+            imageInfos[k] = vk::DescriptorImageInfo(textureSampler[j], textureImageView[j], vk::ImageLayout::eShaderReadOnlyOptimal);
+            descriptorWrites[k]
                 .setDstSet(descriptorSets[idx])
                 .setDstBinding(1)
-                .setDstArrayElement(0)
+                .setDstArrayElement(static_cast<uint32_t>(j))
                 .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-                .setDescriptorCount(texturePaths.size())
-                .setPImageInfo(imageInfos.data());
+                .setDescriptorCount(1)
+                .setPImageInfo(&imageInfos[k]);
+        }
+        device.updateDescriptorSets(static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        boundTextures[idx] = residentTextures.size();
+    }
+
+    void createCullDescriptorSets() {
+        if (!meshletCulling) {
+            return;
+        }
+        std::vector<vk::DescriptorSetLayout> layouts(swapChainImages.size(), meshletCuller->descriptorSetLayout);
+        vk::DescriptorSetAllocateInfo allocInfo(
+            descriptorPool,
+            static_cast<uint32_t>(swapChainImages.size()),
+            layouts.data()
+        );
+        cullDescriptorSets.resize(swapChainImages.size());
+
+        if (device.allocateDescriptorSets(&allocInfo, cullDescriptorSets.data()) != vk::Result::eSuccess) {
+            throw std::runtime_error("failed to allocate descriptor sets!");
+        }
+
+        for (size_t idx = 0; idx < swapChainImages.size(); ++idx) {
+            std::array<vk::DescriptorBufferInfo, 4> bufferInfos = {
+                vk::DescriptorBufferInfo(uniformBuffers[idx], 0, sizeof(UniformBufferObject)),
+                vk::DescriptorBufferInfo(meshletBuffer, 0, VK_WHOLE_SIZE),
+                vk::DescriptorBufferInfo(indirectBuffers[idx], 0, VK_WHOLE_SIZE),
+                vk::DescriptorBufferInfo(drawCountBuffers[idx], 0, VK_WHOLE_SIZE),
+            };
+
+            std::array<vk::WriteDescriptorSet, 4> descriptorWrites{};
+            for (uint32_t binding = 0; binding < descriptorWrites.size(); ++binding) {
+                descriptorWrites[binding]
+                    .setDstSet(cullDescriptorSets[idx])
+                    .setDstBinding(binding)
+                    .setDstArrayElement(0)
+                    .setDescriptorType(binding == 0 ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer)
+                    .setDescriptorCount(1)
+                    .setPBufferInfo(&bufferInfos[binding]);
+            }
 
             device.updateDescriptorSets(static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
         }
     }
 
-    void copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size) {
-        vk::CommandBufferAllocateInfo allocInfo(commandPool, vk::CommandBufferLevel::ePrimary, 1);
-
-        vk::CommandBuffer commandBuffer = vklearn::beginSingleTimeCommands(device, commandPool);
+    // clears the per draw counts, culls the level's meshlets and makes the commands visible to the indirect draws
+    void recordMeshletCulling(vk::CommandBuffer commandBuffer, size_t image, const Model::LodLevel& level) {
+        commandBuffer.fillBuffer(drawCountBuffers[image], 0, VK_WHOLE_SIZE, 0);
+        vk::BufferMemoryBarrier cleared(
+            vk::AccessFlagBits::eTransferWrite,
+            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+            drawCountBuffers[image], 0, VK_WHOLE_SIZE
+        );
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eComputeShader,
+            {},
+            0, nullptr,
+            1, &cleared,
+            0, nullptr
+        );
 
-        vk::BufferCopy copyRegion(0, 0, size);
-        commandBuffer.copyBuffer(srcBuffer, dstBuffer, 1, &copyRegion);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, meshletCuller->computePipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, meshletCuller->pipelineLayout, 0, 1, &cullDescriptorSets[image], 0, nullptr);
+        // the level's draws, and so their meshlets, are contiguous
+        uint32_t firstMeshlet = draws[level.firstDraw].firstMeshlet;
+        const Model::DrawRange& lastDraw = draws[level.firstDraw + level.drawCount - 1];
+        uint32_t levelMeshlets = lastDraw.firstMeshlet + lastDraw.meshletCount - firstMeshlet;
+        CullConstants constants{firstMeshlet, levelMeshlets, meshletCount, static_cast<uint32_t>(draws.size()), drawIndirectCount ? 1u : 0u};
+        commandBuffer.pushConstants(meshletCuller->pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullConstants), &constants);
+        commandBuffer.dispatch((levelMeshlets + 63) / 64, 1, 1);
+
+        std::array<vk::BufferMemoryBarrier, 2> written = {
+            vk::BufferMemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, indirectBuffers[image], 0, VK_WHOLE_SIZE),
+            vk::BufferMemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, drawCountBuffers[image], 0, VK_WHOLE_SIZE),
+        };
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eDrawIndirect,
+            {},
+            0, nullptr,
+            static_cast<uint32_t>(written.size()), written.data(),
+            0, nullptr
+        );
+    }
 
-        vklearn::endSingleTimeCommands(device, commandPool, commandBuffer, graphicsQueue);
+    // pass 0: model, 1: edge. each draw's meshlet commands start at its firstMeshlet slot
+    void recordDraw(vk::CommandBuffer commandBuffer, size_t image, uint32_t pass, size_t j) {
+        const Model::DrawRange& draw = draws[j];
+        if (!meshletCulling) {
+            commandBuffer.drawIndexed(draw.indexCount, 1, draw.firstIndex, 0, 0);
+            return;
+        }
+        vk::DeviceSize stride = sizeof(vk::DrawIndexedIndirectCommand);
+        vk::DeviceSize offset = (static_cast<vk::DeviceSize>(pass) * meshletCount + draw.firstMeshlet) * stride;
+        if (drawIndirectCount) {
+            vk::DeviceSize countOffset = (pass * draws.size() + j) * sizeof(uint32_t);
+            commandBuffer.drawIndexedIndirectCount(indirectBuffers[image], offset, drawCountBuffers[image], countOffset, draw.meshletCount, stride);
+        } else {
+            commandBuffer.drawIndexedIndirect(indirectBuffers[image], offset, draw.meshletCount, stride);
+        }
     }
 
+    // one command buffer per level of detail and swapchain image: commandBuffers[lod * images + image]
     void createCommandBuffers() {
-        commandBuffers.resize(swapChainFramebuffers.size());
+        size_t imageCount = swapChainFramebuffers.size();
+        commandBuffers.resize(lods.size() * imageCount);
         vk::CommandBufferAllocateInfo allocInfo(
             commandPool,
             vk::CommandBufferLevel::ePrimary,
@@ -1138,46 +1947,77 @@ private:
             throw std::runtime_error("failed to allocate command buffers!");
         }
 
-        for (size_t idx = 0; idx < commandBuffers.size(); idx++) {
-            vk::CommandBufferBeginInfo beginInfo({}, nullptr);
-            if (commandBuffers[idx].begin(&beginInfo) != vk::Result::eSuccess) {
-                throw std::runtime_error("failed to begin recording command buffer!");
-            }
-            std::array<vk::ClearValue, 2> clearValues{};
-            clearValues[0].color = vk::ClearColorValue(std::array<float, 4>{1.0, 1.0, 1.0, 1.0});
-            clearValues[1].depthStencil = vk::ClearDepthStencilValue(1.0f, 0);
-            vk::RenderPassBeginInfo renderPassInfo(
-                renderPass,
-                swapChainFramebuffers[idx],
-                vk::Rect2D({0, 0}, swapChainDetails.extent),
-                static_cast<uint32_t>(clearValues.size()),
-                clearValues.data()
-            );
-            commandBuffers[idx].beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
-            commandBuffers[idx].bindPipeline(vk::PipelineBindPoint::eGraphics, modelRenderer->graphicsPipeline);
-            // commandBuffers[idx].draw(3, 1, 0, 0);
-            // commandBuffers[idx].endRenderPass();
-            vk::Buffer vertexBuffers[] = {vertexBuffer};
-            vk::DeviceSize offsets[] = {0};
-            commandBuffers[idx].bindVertexBuffers(0, 1, vertexBuffers, offsets);
-            commandBuffers[idx].bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint16);
-            commandBuffers[idx].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, modelRenderer->pipelineLayout, 0, 1, &descriptorSets[idx], 0, nullptr);
-            uint32_t firstIndex = 0;
-            for (int j=0; j < vertexCounts.size(); ++j) {
-                commandBuffers[idx].drawIndexed(vertexCounts[j], 1, firstIndex, 0, 0);
-                firstIndex += vertexCounts[j];
-            }
+        recordedMesh.assign(imageCount, false);
+        recordedSrgbGray.assign(imageCount, 0);
+        for (size_t idx = 0; idx < imageCount; idx++) {
+            recordCommandBuffers(idx);
+        }
+    }
 
-            
-            commandBuffers[idx].bindPipeline(vk::PipelineBindPoint::eGraphics, edgeRenderer->graphicsPipeline);
-            commandBuffers[idx].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, edgeRenderer->pipelineLayout, 0, 1, &descriptorSets[idx], 0, nullptr);
-            firstIndex = 0;
-            for (int j=0; j < vertexCounts.size(); ++j) {
-                commandBuffers[idx].drawIndexed(vertexCounts[j], 1, firstIndex, 0, 0);
-                firstIndex += vertexCounts[j];
-            }
-            commandBuffers[idx].end();
+    // records every level of detail for one image; done again once the mesh is resident or a bc4
+    // texture changes the draw constants
+    void recordCommandBuffers(size_t idx) {
+        size_t imageCount = swapChainFramebuffers.size();
+        for (uint32_t lod = 0; lod < lods.size(); lod++) {
+            recordCommandBuffer(commandBuffers[lod * imageCount + idx], idx, lod);
+        }
+        recordedMesh[idx] = meshResident;
+        recordedSrgbGray[idx] = srgbGrayTextures;
+    }
+
+    DrawConstants drawConstants(int32_t texture) const {
+        return DrawConstants{textureSlot(texture), texture >= 0 && textureSrgbGray[texture] ? 1u : 0u};
+    }
+
+    void recordCommandBuffer(vk::CommandBuffer commandBuffer, size_t idx, uint32_t lod) {
+        const Model::LodLevel& level = lods[lod];
+        vk::CommandBufferBeginInfo beginInfo({}, nullptr);
+        if (commandBuffer.begin(&beginInfo) != vk::Result::eSuccess) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+        if (meshletCulling && meshResident) {
+            recordMeshletCulling(commandBuffer, idx, level);
+        }
+        std::array<vk::ClearValue, 2> clearValues{};
+        clearValues[0].color = vk::ClearColorValue(std::array<float, 4>{1.0, 1.0, 1.0, 1.0});
+        clearValues[1].depthStencil = vk::ClearDepthStencilValue(1.0f, 0);
+        vk::RenderPassBeginInfo renderPassInfo(
+            renderPass,
+            swapChainFramebuffers[idx],
+            vk::Rect2D({0, 0}, swapChainDetails.extent),
+            static_cast<uint32_t>(clearValues.size()),
+            clearValues.data()
+        );
+        commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
+        if (!meshResident) {
+            // clear only until the mesh upload lands
+            commandBuffer.endRenderPass();
+            commandBuffer.end();
+            return;
+        }
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, modelRenderer->graphicsPipeline);
+        // commandBuffer.draw(3, 1, 0, 0);
+        vk::Buffer vertexBuffers[] = {vertexBuffer, vertexBuffer};
+        vk::DeviceSize offsets[] = {0, attributeStreamOffset};
+        commandBuffer.bindVertexBuffers(0, 2, vertexBuffers, offsets);
+        commandBuffer.bindIndexBuffer(indexBuffer, 0, indexType);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, modelRenderer->pipelineLayout, 0, 1, &descriptorSets[idx], 0, nullptr);
+        for (size_t j = level.firstDraw; j < level.firstDraw + level.drawCount; ++j) {
+            DrawConstants constants = drawConstants(draws[j].texture);
+            commandBuffer.pushConstants(modelRenderer->pipelineLayout, vk::ShaderStageFlagBits::eFragment, 0, sizeof(DrawConstants), &constants);
+            recordDraw(commandBuffer, idx, 0, j);
+        }
+
+        
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, edgeRenderer->graphicsPipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, edgeRenderer->pipelineLayout, 0, 1, &descriptorSets[idx], 0, nullptr);
+        for (size_t j = level.firstDraw; j < level.firstDraw + level.drawCount; ++j) {
+            DrawConstants constants = drawConstants(draws[j].texture);
+            commandBuffer.pushConstants(edgeRenderer->pipelineLayout, vk::ShaderStageFlagBits::eFragment, 0, sizeof(DrawConstants), &constants);
+            recordDraw(commandBuffer, idx, 1, j);
         }
+        commandBuffer.endRenderPass();
+        commandBuffer.end();
     }
 
     void createSyncObjects() {
@@ -1212,6 +2052,13 @@ private:
             device.freeMemory(uniformBuffersMemory[idx]);
         }
 
+        for (size_t idx = 0; idx < indirectBuffers.size(); idx++) {
+            device.destroyBuffer(indirectBuffers[idx]);
+            device.freeMemory(indirectBuffersMemory[idx]);
+            device.destroyBuffer(drawCountBuffers[idx]);
+            device.freeMemory(drawCountBuffersMemory[idx]);
+        }
+
         modelRenderer->destroy();
         edgeRenderer->destroy();
         device.destroyDescriptorPool(descriptorPool);
@@ -1245,8 +2092,10 @@ private:
         createDepthResources();
         createFramebuffers();
         createUniformBuffers();
+        createIndirectBuffers();
         createDescriptorPool();
         createDescriptorSets();
+        createCullDescriptorSets();
         createCommandBuffers();
     }
 
@@ -1292,18 +2141,29 @@ private:
         }
         imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
-        vk::Semaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
+        // this image's previous frame has finished, so its set and command buffers can be updated
+        streamTextures();
+        updateResidency();
+        bindResidentTextures(imageIndex);
+        if (recordedMesh[imageIndex] != meshResident || recordedSrgbGray[imageIndex] != srgbGrayTextures) {
+            recordCommandBuffers(imageIndex);
+        }
+
+        vk::Semaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame], uploader->timeline};
         vk::Semaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-        vk::PipelineStageFlags waitStages[] = {vk::PipelineStageFlagBits::eColorAttachmentOutput};
+        vk::PipelineStageFlags waitStages[] = {vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eAllCommands};
+        uint64_t waitValues[] = {0, residentValue};
+        vk::TimelineSemaphoreSubmitInfo timelineInfo(2, waitValues, 0, nullptr);
         updateUniformBuffer(imageIndex);
         vk::SubmitInfo submitInfo(
-            1,
+            2,
             waitSemaphores,
             waitStages,
             1,
-            &commandBuffers[imageIndex],
+            &commandBuffers[currentLod * swapChainImages.size() + imageIndex],
             1,
             signalSemaphores);
+        submitInfo.setPNext(&timelineInfo);
         device.resetFences({inFlightFences[currentFrame]});
         graphicsQueue.submit({submitInfo}, inFlightFences[currentFrame]);
         vk::SwapchainKHR swapChains[] = {swapChain};
@@ -1328,6 +2188,19 @@ private:
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
     }
 
+    // coarsest level whose error, projected at the model's nearest point, stays within LOD_PIXEL_ERROR
+    uint32_t selectLod(const UniformBufferObject& ubo) {
+        float distance = std::max(glm::length(glm::vec3(ubo.camera) - glm::vec3(modelBounds)) - modelBounds.w, 0.1f); // no closer than the near plane
+        float pixelsPerUnit = std::abs(ubo.proj[1][1]) * swapChainDetails.extent.height * 0.5f / distance;
+        uint32_t lod = 0;
+        for (uint32_t j = 1; j < lods.size(); ++j) {
+            if (lods[j].error * pixelsPerUnit <= LOD_PIXEL_ERROR) {
+                lod = j;
+            }
+        }
+        return lod;
+    }
+
     void updateUniformBuffer(uint32_t currentImage) {
         static auto startTime = std::chrono::high_resolution_clock::now();
 
@@ -1353,6 +2226,16 @@ private:
         );
         ubo.proj[1][1] *= -1; // Y coordinate upside down
         ubo.invModel = glm::inverse(ubo.model);
+        ubo.camera = glm::inverse(ubo.view * ubo.model)[3];
+        ubo.positionScale = vertexQuantization.scale;
+        ubo.positionBias = vertexQuantization.bias;
+        ubo.edgeOffset = EDGE_OFFSET;
+
+        uint32_t lod = selectLod(ubo);
+        if (lod != currentLod) {
+            std::cout << "lod " << currentLod << " -> " << lod << std::endl;
+            currentLod = lod;
+        }
 
         void* data;
         device.mapMemory(uniformBuffersMemory[currentImage], 0, sizeof(ubo), {}, &data);
@@ -1363,17 +2246,32 @@ private:
     void cleanup() {
         cleanupSwapChain();
 
+        delete textureDecoder;
+        delete uploader;
+
         for (int j=0; j < texturePaths.size(); ++j) {
+            if (textureReady[j] == 0) {
+                continue; // never uploaded
+            }
             device.destroySampler(textureSampler[j]);
             device.destroyImageView(textureImageView[j]);
             device.destroyImage(textureImage[j]);
             device.freeMemory(textureImageMemory[j]);
         }
+        device.destroySampler(placeholderSampler);
+        device.destroyImageView(placeholderImageView);
+        device.destroyImage(placeholderImage);
+        device.freeMemory(placeholderImageMemory);
 
         device.destroyBuffer(indexBuffer);
         device.freeMemory(indexBufferMemory);
         device.destroyBuffer(vertexBuffer);
         device.freeMemory(vertexBufferMemory);
+        if (meshletCulling) {
+            device.destroyBuffer(meshletBuffer);
+            device.freeMemory(meshletBufferMemory);
+        }
+        delete meshletCuller;
 
         for (size_t idx = 0; idx < MAX_FRAMES_IN_FLIGHT; idx++) {
             device.destroySemaphore(renderFinishedSemaphores[idx]);
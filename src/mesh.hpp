@@ -0,0 +1,1355 @@
+#ifndef MESH_INCLUDED
+#define MESH_INCLUDED
+
+#include "model.hpp"
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+// optimization passes over an upload-ready Model::Mesh, run once before it is cached
+namespace MeshOptimizer {
+
+    static_assert(sizeof(Model::Vertex) == 8 * sizeof(uint32_t), "Model::Vertex is hashed as eight 32-bit words");
+
+    // per-word multiply + xor fold; the word loop has a fixed trip count so it vectorizes
+    uint32_t hash_vertex(const Model::Vertex& v) {
+        static const uint32_t k[8] = {
+            0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu,
+            0x165667B1u, 0xD3A2646Cu, 0xFD7046C5u, 0xB55A4F09u,
+        };
+        uint32_t w[8];
+        std::memcpy(w, &v, sizeof(w));
+        uint32_t h = 0;
+        for (int j = 0; j < 8; ++j) {
+            h ^= (w[j] ^ (w[j] >> 15)) * k[j];
+        }
+        h ^= h >> 16;
+        h *= 0x7FEB352Du;
+        h ^= h >> 15;
+        return h;
+    }
+
+    bool same_vertex(const Model::Vertex& a, const Model::Vertex& b) {
+        return std::memcmp(&a, &b, sizeof(Model::Vertex)) == 0;
+    }
+
+    template <typename Index>
+    void remap_indices(std::vector<Index>& indices, const std::vector<uint32_t>& remap) {
+        for (auto& index : indices) {
+            index = static_cast<Index>(remap[index]);
+        }
+    }
+
+    // keeps FaceIndices at uint16 whenever the vertex count allows it
+    void fit_index_size(PMXLoader::FaceIndices& indices, size_t vertex_count) {
+        if (indices.index_size == 4 && vertex_count <= 0x10000) {
+            indices.u16.assign(indices.u32.begin(), indices.u32.end());
+            indices.u32 = {};
+            indices.index_size = 2;
+        }
+    }
+
+    struct DedupStats {
+        size_t vertices_before;
+        size_t vertices_after;
+        size_t index_bytes_before;
+        size_t index_bytes_after;
+    };
+
+    // merges bitwise identical vertices (position, normal, uv) and drops unreferenced ones.
+    // open addressing with linear probing over a power-of-two table at most half full.
+    DedupStats deduplicate_vertices(Model::Mesh& mesh) {
+        const uint32_t EMPTY = UINT32_MAX;
+        size_t vertex_count = mesh.vertices.size();
+        DedupStats stats{vertex_count, 0, mesh.indices.size() * mesh.indices.index_size, 0};
+
+        std::vector<uint32_t> remap(vertex_count, EMPTY);
+        for (size_t j = 0; j < mesh.indices.size(); ++j) {
+            remap[mesh.indices[j]] = 0;
+        }
+
+        size_t capacity = 1;
+        while (capacity < 2 * vertex_count) {
+            capacity <<= 1;
+        }
+        std::vector<uint32_t> table(capacity, EMPTY);
+        size_t mask = capacity - 1;
+
+        std::vector<Model::Vertex> vertices;
+        vertices.reserve(vertex_count);
+        for (size_t j = 0; j < vertex_count; ++j) {
+            if (remap[j] == EMPTY) {
+                continue;
+            }
+            const Model::Vertex& v = mesh.vertices[j];
+            size_t slot = hash_vertex(v) & mask;
+            while (table[slot] != EMPTY && !same_vertex(vertices[table[slot]], v)) {
+                slot = (slot + 1) & mask;
+            }
+            if (table[slot] == EMPTY) {
+                table[slot] = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(v);
+            }
+            remap[j] = table[slot];
+        }
+
+        if (mesh.indices.index_size == 2) {
+            remap_indices(mesh.indices.u16, remap);
+        } else {
+            remap_indices(mesh.indices.u32, remap);
+        }
+        mesh.vertices = std::move(vertices);
+        fit_index_size(mesh.indices, mesh.vertices.size());
+
+        stats.vertices_after = mesh.vertices.size();
+        stats.index_bytes_after = mesh.indices.size() * mesh.indices.index_size;
+        return stats;
+    }
+
+    struct CacheStats {
+        double acmr;  // transformed vertices per triangle, 0.5 is ideal for a regular grid, 3 is the worst
+        double atvr;  // transformed vertices per referenced vertex, 1 is ideal
+    };
+
+    // simulates a FIFO post-transform cache of cache_size entries over the whole index buffer
+    template <typename Index>
+    CacheStats analyze_vertex_cache(const std::vector<Index>& indices, size_t vertex_count, size_t cache_size = 16) {
+        std::vector<uint32_t> stamp(vertex_count, 0);  // FIFO time the vertex entered the cache, 0: never
+        std::vector<bool> used(vertex_count, false);
+        uint32_t time = cache_size + 1;
+        size_t misses = 0, unique = 0;
+        for (Index index : indices) {
+            if (!used[index]) {
+                used[index] = true;
+                unique++;
+            }
+            if (stamp[index] == 0 || time - stamp[index] > cache_size) {
+                stamp[index] = time++;
+                misses++;
+            }
+        }
+        size_t triangles = indices.size() / 3;
+        return {triangles ? double(misses) / triangles : 0.0, unique ? double(misses) / unique : 0.0};
+    }
+
+    CacheStats analyze_vertex_cache(const Model::Mesh& mesh) {
+        if (mesh.indices.index_size == 2) {
+            return analyze_vertex_cache(mesh.indices.u16, mesh.vertices.size());
+        }
+        return analyze_vertex_cache(mesh.indices.u32, mesh.vertices.size());
+    }
+
+    // Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+    const int FORSYTH_CACHE_SIZE = 32;
+
+    float forsyth_vertex_score(int cache_position, uint32_t live_triangles) {
+        if (live_triangles == 0) {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cache_position >= 0) {
+            if (cache_position < 3) {
+                // the last triangle's vertices get a fixed score so the next one does not reuse all of them
+                score = 0.75f;
+            } else {
+                float x = 1.0f - float(cache_position - 3) / (FORSYTH_CACHE_SIZE - 3);
+                score = std::pow(x, 1.5f);
+            }
+        }
+        // favour vertices with few triangles left so they leave the cache for good
+        return score + 2.0f / std::sqrt(float(live_triangles));
+    }
+
+    // vertex ids local to one draw range; global_to_local is all -1 between calls
+    struct ForsythScratch {
+        std::vector<int32_t> global_to_local;
+    };
+
+    // reorders the triangles of indices[0, index_count) in place
+    template <typename Index>
+    void optimize_vertex_cache_range(Index* indices, size_t index_count, ForsythScratch& scratch) {
+        size_t triangle_count = index_count / 3;
+        if (triangle_count < 2) {
+            return;
+        }
+        index_count = 3 * triangle_count;
+
+        std::vector<Index> local_to_global;
+        std::vector<uint32_t> local(index_count);
+        for (size_t j = 0; j < index_count; ++j) {
+            int32_t& id = scratch.global_to_local[indices[j]];
+            if (id < 0) {
+                id = static_cast<int32_t>(local_to_global.size());
+                local_to_global.push_back(indices[j]);
+            }
+            local[j] = static_cast<uint32_t>(id);
+        }
+        for (Index v : local_to_global) {
+            scratch.global_to_local[v] = -1;
+        }
+        size_t vertex_count = local_to_global.size();
+
+        // triangles adjacent to each vertex; the first live_triangles[v] entries are not emitted yet
+        std::vector<uint32_t> live_triangles(vertex_count, 0);
+        for (uint32_t v : local) {
+            live_triangles[v]++;
+        }
+        std::vector<uint32_t> first_adjacent(vertex_count + 1, 0);
+        for (size_t v = 0; v < vertex_count; ++v) {
+            first_adjacent[v + 1] = first_adjacent[v] + live_triangles[v];
+        }
+        std::vector<uint32_t> adjacency(index_count);
+        {
+            std::vector<uint32_t> fill(first_adjacent.begin(), first_adjacent.end() - 1);
+            for (size_t j = 0; j < index_count; ++j) {
+                adjacency[fill[local[j]]++] = static_cast<uint32_t>(j / 3);
+            }
+        }
+
+        std::vector<float> vertex_score(vertex_count);
+        for (size_t v = 0; v < vertex_count; ++v) {
+            vertex_score[v] = forsyth_vertex_score(-1, live_triangles[v]);
+        }
+        std::vector<float> triangle_score(triangle_count);
+        for (size_t t = 0; t < triangle_count; ++t) {
+            triangle_score[t] = vertex_score[local[3 * t]] + vertex_score[local[3 * t + 1]] + vertex_score[local[3 * t + 2]];
+        }
+        std::vector<bool> emitted(triangle_count, false);
+
+        std::vector<Index> output;
+        output.reserve(index_count);
+        std::vector<uint32_t> cache, next_cache;
+        cache.reserve(FORSYTH_CACHE_SIZE + 3);
+        next_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+        int64_t best = std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin();
+        size_t cursor = 0;
+        for (size_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count) {
+            if (best < 0) {
+                // nothing adjacent to the cache is left: restart from the first remaining triangle
+                while (emitted[cursor]) {
+                    cursor++;
+                }
+                best = static_cast<int64_t>(cursor);
+            }
+
+            const uint32_t* tri = &local[3 * best];
+            emitted[best] = true;
+            next_cache.clear();
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = tri[k];
+                output.push_back(local_to_global[v]);
+                next_cache.push_back(v);
+
+                uint32_t* adjacent = &adjacency[first_adjacent[v]];
+                uint32_t* last = adjacent + live_triangles[v];
+                *std::find(adjacent, last, static_cast<uint32_t>(best)) = *(last - 1);
+                live_triangles[v]--;
+            }
+            for (uint32_t v : cache) {
+                if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                    next_cache.push_back(v);
+                }
+            }
+            std::swap(cache, next_cache);
+
+            best = -1;
+            float best_score = -1.0f;
+            for (size_t k = 0; k < cache.size(); ++k) {
+                uint32_t v = cache[k];
+                int position = k < FORSYTH_CACHE_SIZE ? static_cast<int>(k) : -1;
+                float delta = forsyth_vertex_score(position, live_triangles[v]) - vertex_score[v];
+                vertex_score[v] += delta;
+                for (uint32_t a = first_adjacent[v]; a < first_adjacent[v] + live_triangles[v]; ++a) {
+                    uint32_t t = adjacency[a];
+                    triangle_score[t] += delta;
+                    if (triangle_score[t] > best_score) {
+                        best_score = triangle_score[t];
+                        best = t;
+                    }
+                }
+            }
+            if (cache.size() > FORSYTH_CACHE_SIZE) {
+                cache.resize(FORSYTH_CACHE_SIZE);
+            }
+        }
+
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    // reorders triangles inside each draw range; ranges themselves keep their place
+    template <typename Index>
+    void optimize_vertex_cache(std::vector<Index>& indices, const std::vector<Model::DrawRange>& draws, size_t vertex_count) {
+        ForsythScratch scratch{std::vector<int32_t>(vertex_count, -1)};
+        for (const auto& draw : draws) {
+            if (draw.firstIndex + static_cast<size_t>(draw.indexCount) <= indices.size()) {
+                optimize_vertex_cache_range(indices.data() + draw.firstIndex, draw.indexCount, scratch);
+            }
+        }
+    }
+
+    void optimize_vertex_cache(Model::Mesh& mesh) {
+        if (mesh.indices.index_size == 2) {
+            optimize_vertex_cache(mesh.indices.u16, mesh.draws, mesh.vertices.size());
+        } else {
+            optimize_vertex_cache(mesh.indices.u32, mesh.draws, mesh.vertices.size());
+        }
+    }
+
+    // the position of vertex k (0..2) of the triangle whose indices start at tri
+    template <typename Index>
+    glm::vec3 triangle_position(const Model::Mesh& mesh, const Index* tri, int k) {
+        return mesh.vertices[tri[k]].pos;
+    }
+
+    template <typename Index>
+    glm::vec3 triangle_normal(const Model::Mesh& mesh, const Index* tri) {
+        // from the authored vertex normals, so winding conventions do not matter
+        return mesh.vertices[tri[0]].color + mesh.vertices[tri[1]].color + mesh.vertices[tri[2]].color;
+    }
+
+    // CPU overdraw estimate: rasterizes the mesh in draw order from view_count directions spread over
+    // the sphere (orthographic, resolution^2 pixels, back faces culled by vertex normals, depth test
+    // LESS as in the model pass) and returns shaded fragments / covered pixels averaged over the views.
+    template <typename Index>
+    double estimate_overdraw(const Model::Mesh& mesh, const std::vector<Index>& indices, int view_count = 12, int resolution = 256) {
+        if (mesh.vertices.empty() || indices.size() < 3) {
+            return 0.0;
+        }
+        glm::vec3 lo = mesh.vertices[0].pos, hi = lo;
+        for (const auto& v : mesh.vertices) {
+            lo = glm::min(lo, v.pos);
+            hi = glm::max(hi, v.pos);
+        }
+        glm::vec3 center = (lo + hi) * 0.5f;
+        float radius = std::max(glm::length(hi - lo) * 0.5f, 1e-6f);
+        float scale = resolution / (2.0f * radius);
+
+        std::vector<float> depth(resolution * resolution);
+        std::vector<glm::vec3> projected(mesh.vertices.size());
+        double total = 0.0;
+        for (int view = 0; view < view_count; ++view) {
+            // fibonacci sphere
+            float z = 1.0f - (2.0f * view + 1.0f) / view_count;
+            float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            float phi = view * 2.39996323f;
+            glm::vec3 dir(r * std::cos(phi), r * std::sin(phi), z);
+            glm::vec3 right = glm::normalize(glm::cross(std::fabs(dir.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), dir));
+            glm::vec3 up = glm::cross(dir, right);
+
+            for (size_t j = 0; j < mesh.vertices.size(); ++j) {
+                glm::vec3 p = mesh.vertices[j].pos - center;
+                projected[j] = glm::vec3((glm::dot(p, right) + radius) * scale, (glm::dot(p, up) + radius) * scale, glm::dot(p, dir));
+            }
+            std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+
+            size_t shaded = 0;
+            for (size_t t = 0; t + 3 <= indices.size(); t += 3) {
+                const Index* tri = &indices[t];
+                if (glm::dot(triangle_normal(mesh, tri), dir) >= 0.0f) {
+                    continue;
+                }
+                glm::vec3 a = projected[tri[0]], b = projected[tri[1]], c = projected[tri[2]];
+                float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+                if (area == 0.0f) {
+                    continue;
+                }
+                int x0 = std::max(0, static_cast<int>(std::floor(std::min({a.x, b.x, c.x}))));
+                int x1 = std::min(resolution - 1, static_cast<int>(std::ceil(std::max({a.x, b.x, c.x}))));
+                int y0 = std::max(0, static_cast<int>(std::floor(std::min({a.y, b.y, c.y}))));
+                int y1 = std::min(resolution - 1, static_cast<int>(std::ceil(std::max({a.y, b.y, c.y}))));
+                for (int y = y0; y <= y1; ++y) {
+                    for (int x = x0; x <= x1; ++x) {
+                        float px = x + 0.5f, py = y + 0.5f;
+                        float w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) / area;
+                        float w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) / area;
+                        float w2 = 1.0f - w0 - w1;
+                        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+                            continue;
+                        }
+                        float d = w0 * a.z + w1 * b.z + w2 * c.z;
+                        float& stored = depth[y * resolution + x];
+                        if (d < stored) {
+                            stored = d;
+                            shaded++;
+                        }
+                    }
+                }
+            }
+            size_t covered = std::count_if(depth.begin(), depth.end(), [](float d) { return d != std::numeric_limits<float>::max(); });
+            total += covered ? double(shaded) / covered : 1.0;
+        }
+        return total / view_count;
+    }
+
+    double estimate_overdraw(const Model::Mesh& mesh) {
+        if (mesh.indices.index_size == 2) {
+            return estimate_overdraw(mesh, mesh.indices.u16);
+        }
+        return estimate_overdraw(mesh, mesh.indices.u32);
+    }
+
+    // the simulated cache shared by every range of one optimize_overdraw call. entries older than
+    // time - cache_size are misses, so advancing time past cache_size empties the cache without
+    // touching the array
+    struct OverdrawScratch {
+        std::vector<uint32_t> stamp;  // per vertex: the time it entered the cache, 0: never
+        uint32_t time = 0;
+    };
+
+    // Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+    // splits a cache optimized range into clusters wherever the cache restarts anyway, or where cutting
+    // keeps the cluster's ACMR within threshold times the range's, then sorts the clusters so the ones
+    // facing away from the area-weighted centroid of this draw range (front-most from most view
+    // directions) are drawn first.
+    template <typename Index>
+    void optimize_overdraw_range(const Model::Mesh& mesh, Index* indices, size_t index_count, float threshold, OverdrawScratch& scratch,
+                                 size_t cache_size = 16) {
+        size_t triangle_count = index_count / 3;
+        if (triangle_count < 2) {
+            return;
+        }
+
+        // FIFO simulation per triangle; a new cluster starts when the cache was flushed or the current
+        // cluster is cheap enough to cut without exceeding the threshold
+        std::vector<uint32_t>& stamp = scratch.stamp;
+        uint32_t& time = scratch.time;
+        auto reset = [&] {
+            if (time > UINT32_MAX / 2) {
+                std::fill(stamp.begin(), stamp.end(), 0);
+                time = 0;
+            }
+            time += static_cast<uint32_t>(cache_size) + 1;
+        };
+        reset();
+        auto misses_of = [&](const Index* tri) {
+            int misses = 0;
+            for (int k = 0; k < 3; ++k) {
+                Index v = tri[k];
+                if (stamp[v] == 0 || time - stamp[v] > cache_size) {
+                    stamp[v] = time++;
+                    misses++;
+                }
+            }
+            return misses;
+        };
+
+        size_t range_misses = 0;
+        for (size_t t = 0; t < triangle_count; ++t) {
+            range_misses += misses_of(indices + 3 * t);
+        }
+        reset();
+        double limit = threshold * double(range_misses) / triangle_count;
+
+        std::vector<size_t> cluster_start;
+        size_t cluster_misses = 0, cluster_triangles = 0;
+        for (size_t t = 0; t < triangle_count; ++t) {
+            int misses = misses_of(indices + 3 * t);
+            if (cluster_triangles == 0 || misses == 3) {
+                if (cluster_triangles == 0 || cluster_start.back() != t) {
+                    cluster_start.push_back(t);
+                }
+                cluster_misses = 0;
+                cluster_triangles = 0;
+            }
+            cluster_misses += misses;
+            cluster_triangles++;
+            if (double(cluster_misses) / cluster_triangles <= limit && t + 1 < triangle_count) {
+                // restart the simulated cache as the next cluster may be drawn after any other
+                reset();
+                cluster_triangles = 0;
+            }
+        }
+        reset();
+        cluster_start.push_back(triangle_count);
+
+        glm::vec3 range_center(0.0f);
+        float range_area = 0.0f;
+        struct Cluster { size_t first, last; float key; };
+        std::vector<Cluster> clusters;
+        std::vector<glm::vec3> centroids;
+        std::vector<glm::vec3> normals;
+        for (size_t c = 0; c + 1 < cluster_start.size(); ++c) {
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = cluster_start[c]; t < cluster_start[c + 1]; ++t) {
+                const Index* tri = indices + 3 * t;
+                glm::vec3 a = triangle_position(mesh, tri, 0), b = triangle_position(mesh, tri, 1), d = triangle_position(mesh, tri, 2);
+                float w = glm::length(glm::cross(b - a, d - a)) * 0.5f;
+                centroid += (a + b + d) * (w / 3.0f);
+                normal += triangle_normal(mesh, tri) * w;
+                area += w;
+            }
+            range_center += centroid;
+            range_area += area;
+            centroids.push_back(area > 0.0f ? centroid / area : centroid);
+            normals.push_back(normal);
+            clusters.push_back({cluster_start[c], cluster_start[c + 1], 0.0f});
+        }
+        if (clusters.size() < 2 || range_area == 0.0f) {
+            return;
+        }
+        range_center /= range_area;
+        for (size_t c = 0; c < clusters.size(); ++c) {
+            float length = glm::length(normals[c]);
+            clusters[c].key = length > 0.0f ? glm::dot(centroids[c] - range_center, normals[c] / length) : 0.0f;
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+        std::vector<Index> output;
+        output.reserve(3 * triangle_count);
+        for (const auto& cluster : clusters) {
+            output.insert(output.end(), indices + 3 * cluster.first, indices + 3 * cluster.last);
+        }
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    template <typename Index>
+    void optimize_overdraw(const Model::Mesh& mesh, std::vector<Index>& indices, float threshold) {
+        OverdrawScratch scratch{std::vector<uint32_t>(mesh.vertices.size(), 0)};
+        for (const auto& draw : mesh.draws) {
+            if (draw.firstIndex + static_cast<size_t>(draw.indexCount) <= indices.size()) {
+                optimize_overdraw_range(mesh, indices.data() + draw.firstIndex, draw.indexCount, threshold, scratch);
+            }
+        }
+    }
+
+    void optimize_overdraw(Model::Mesh& mesh, float threshold) {
+        if (mesh.indices.index_size == 2) {
+            optimize_overdraw(mesh, mesh.indices.u16, threshold);
+        } else {
+            optimize_overdraw(mesh, mesh.indices.u32, threshold);
+        }
+    }
+
+    // simulates one pass over indices, fetching only for post-transform cache misses; a miss reads the vertex
+    // from every binding, each a separate buffer of the given stride, through one FIFO cache of cache_lines
+    // 64 byte lines. returns bytes referenced / bytes fetched (1 is ideal)
+    template <typename Index>
+    double analyze_vertex_fetch(const std::vector<Index>& indices, size_t vertex_count, const std::vector<size_t>& strides,
+                                size_t cache_size = 16, size_t cache_lines = 64) {
+        const size_t LINE = 64;
+        std::vector<uint32_t> stamp(vertex_count, 0);
+        std::vector<bool> used(vertex_count, false);
+        // bindings are laid out one after another in line space so they share the line cache
+        std::vector<size_t> first_line;
+        size_t line_count = 0, vertex_bytes = 0;
+        for (size_t stride : strides) {
+            first_line.push_back(line_count);
+            line_count += (vertex_count * stride + LINE - 1) / LINE;
+            vertex_bytes += stride;
+        }
+        std::vector<uint32_t> line_stamp(line_count, 0);
+        uint32_t time = cache_size + 1, line_time = cache_lines + 1;
+        size_t unique = 0, fetched = 0;
+        for (Index index : indices) {
+            if (!used[index]) {
+                used[index] = true;
+                unique++;
+            }
+            if (stamp[index] != 0 && time - stamp[index] <= cache_size) {
+                continue;
+            }
+            stamp[index] = time++;
+            for (size_t binding = 0; binding < strides.size(); ++binding) {
+                size_t begin = index * strides[binding];
+                for (size_t line = begin / LINE; line <= (begin + strides[binding] - 1) / LINE; ++line) {
+                    uint32_t& last_use = line_stamp[first_line[binding] + line];
+                    if (last_use == 0 || line_time - last_use > cache_lines) {
+                        last_use = line_time++;
+                        fetched += LINE;
+                    }
+                }
+            }
+        }
+        return fetched ? double(unique * vertex_bytes) / fetched : 1.0;
+    }
+
+    // the model pass reads both packed streams, the edge pass only the position stream at binding 0;
+    // returns the efficiency over both passes
+    template <typename Index>
+    double analyze_vertex_fetch(const std::vector<Index>& indices, size_t vertex_count) {
+        const size_t POSITION = sizeof(Model::PackedPosition), ATTRIBUTES = sizeof(Model::PackedAttributes);
+        double model = analyze_vertex_fetch(indices, vertex_count, {POSITION, ATTRIBUTES});
+        double edge = analyze_vertex_fetch(indices, vertex_count, {POSITION});
+        // referenced bytes per pass are fixed, so weigh each pass by them to combine the ratios
+        double referenced = POSITION + ATTRIBUTES + POSITION;
+        return referenced / ((POSITION + ATTRIBUTES) / model + POSITION / edge);
+    }
+
+    double analyze_vertex_fetch(const Model::Mesh& mesh) {
+        if (mesh.indices.index_size == 2) {
+            return analyze_vertex_fetch(mesh.indices.u16, mesh.vertices.size());
+        }
+        return analyze_vertex_fetch(mesh.indices.u32, mesh.vertices.size());
+    }
+
+    // numbers vertices in order of first use so fetches walk the vertex buffer forward and rewrites
+    // indices to match; unused vertices keep EMPTY
+    template <typename Index>
+    std::vector<uint32_t> vertex_fetch_remap(std::vector<Index>& indices, size_t vertex_count) {
+        const uint32_t EMPTY = UINT32_MAX;
+        std::vector<uint32_t> remap(vertex_count, EMPTY);
+        uint32_t next = 0;
+        for (auto& index : indices) {
+            uint32_t& id = remap[index];
+            if (id == EMPTY) {
+                id = next++;
+            }
+            index = static_cast<Index>(id);
+        }
+        return remap;
+    }
+
+    void apply_vertex_fetch_remap(std::vector<Model::Vertex>& vertices, const std::vector<uint32_t>& remap) {
+        size_t used = 0;
+        for (uint32_t id : remap) {
+            used += id != UINT32_MAX;
+        }
+        std::vector<Model::Vertex> reordered(used);
+        for (size_t i = 0; i < remap.size(); ++i) {
+            if (remap[i] != UINT32_MAX) {
+                reordered[remap[i]] = vertices[i];
+            }
+        }
+        vertices = std::move(reordered);
+    }
+
+    // only vertices and index values change, so every DrawRange stays valid
+    template <typename Index>
+    void optimize_vertex_fetch(std::vector<Model::Vertex>& vertices, std::vector<Index>& indices) {
+        apply_vertex_fetch_remap(vertices, vertex_fetch_remap(indices, vertices.size()));
+    }
+
+    void optimize_vertex_fetch(Model::Mesh& mesh) {
+        if (mesh.indices.index_size == 2) {
+            optimize_vertex_fetch(mesh.vertices, mesh.indices.u16);
+        } else {
+            optimize_vertex_fetch(mesh.vertices, mesh.indices.u32);
+        }
+    }
+
+    // reorders for fetch only if the simulated efficiency improves; the candidate order is tried on a copy
+    // of the indices, so the vertices are touched only once the remap is kept. returns {before, after}
+    template <typename Index>
+    std::pair<double, double> optimize_vertex_fetch_if_better(std::vector<Model::Vertex>& vertices, std::vector<Index>& indices) {
+        double before = analyze_vertex_fetch(indices, vertices.size());
+        std::vector<Index> reordered = indices;
+        std::vector<uint32_t> remap = vertex_fetch_remap(reordered, vertices.size());
+        double after = analyze_vertex_fetch(reordered, vertices.size());
+        if (after < before) {
+            return {before, before};
+        }
+        indices = std::move(reordered);
+        apply_vertex_fetch_remap(vertices, remap);
+        return {before, after};
+    }
+
+    // IEEE binary16, round to nearest even; out of range values become infinity
+    uint16_t float_to_half(float f) {
+        uint32_t x;
+        std::memcpy(&x, &f, sizeof(x));
+        uint32_t sign = (x >> 16) & 0x8000;
+        uint32_t exponent = (x >> 23) & 0xFF;
+        uint32_t mantissa = x & 0x7FFFFF;
+        if (exponent == 0xFF) {
+            return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+        }
+        int e = static_cast<int>(exponent) - 127 + 15;
+        if (e >= 31) {
+            return static_cast<uint16_t>(sign | 0x7C00);
+        }
+        if (e <= 0) {
+            if (e < -10) {
+                return static_cast<uint16_t>(sign);
+            }
+            mantissa |= 0x800000;
+            int shift = 14 - e;
+            uint32_t half = mantissa >> shift;
+            uint32_t rest = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1))) {
+                half++;
+            }
+            return static_cast<uint16_t>(sign | half);
+        }
+        uint32_t half = (static_cast<uint32_t>(e) << 10) | (mantissa >> 13);
+        uint32_t rest = mantissa & 0x1FFF;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+            half++;  // may carry into the exponent, which is still correctly rounded
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    float half_to_float(uint16_t h) {
+        uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+        uint32_t exponent = (h >> 10) & 0x1F;
+        uint32_t mantissa = h & 0x3FF;
+        uint32_t x;
+        if (exponent == 0) {
+            float f = std::ldexp(static_cast<float>(mantissa), -24);
+            return sign ? -f : f;
+        } else if (exponent == 31) {
+            x = sign | 0x7F800000 | (mantissa << 13);
+        } else {
+            x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+        }
+        float f;
+        std::memcpy(&f, &x, sizeof(f));
+        return f;
+    }
+
+    int8_t to_snorm8(float v) {
+        return static_cast<int8_t>(std::lround(std::clamp(v, -1.0f, 1.0f) * 127.0f));
+    }
+
+    // octahedral normal encoding; decode matches toon_model.vert
+    void encode_octahedral(glm::vec3 n, int8_t out[2]) {
+        float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+        if (sum == 0.0f) {
+            out[0] = out[1] = 0;
+            return;
+        }
+        float x = n.x / sum, y = n.y / sum;
+        if (n.z < 0.0f) {
+            float ox = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float oy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = ox;
+            y = oy;
+        }
+        out[0] = to_snorm8(x);
+        out[1] = to_snorm8(y);
+    }
+
+    glm::vec3 decode_octahedral(const int8_t in[2]) {
+        float x = std::max(in[0] / 127.0f, -1.0f), y = std::max(in[1] / 127.0f, -1.0f);
+        glm::vec3 n(x, y, 1.0f - std::fabs(x) - std::fabs(y));
+        float t = std::max(-n.z, 0.0f);
+        n.x += n.x >= 0.0f ? -t : t;
+        n.y += n.y >= 0.0f ? -t : t;
+        return glm::normalize(n);
+    }
+
+    struct QuantizationError {
+        float max_position;     // model units
+        float rms_position;
+        float max_normal_degrees;
+        float max_texcoord;
+    };
+
+    // packs mesh.vertices into the position and attribute streams and measures the error against the float source
+    QuantizationError quantize_vertices(Model::Mesh& mesh) {
+        glm::vec3 lo(0.0f), hi(0.0f);
+        if (!mesh.vertices.empty()) {
+            lo = hi = mesh.vertices[0].pos;
+        }
+        for (const auto& v : mesh.vertices) {
+            lo = glm::min(lo, v.pos);
+            hi = glm::max(hi, v.pos);
+        }
+        glm::vec3 extent = glm::max(hi - lo, glm::vec3(1e-20f));
+        mesh.quantization = {glm::vec4(extent / 65535.0f, 0.0f), glm::vec4(lo, 0.0f)};
+
+        QuantizationError error{0.0f, 0.0f, 0.0f, 0.0f};
+        double squared = 0.0;
+        mesh.positions.resize(mesh.vertices.size());
+        mesh.attributes.resize(mesh.vertices.size());
+        for (size_t j = 0; j < mesh.vertices.size(); ++j) {
+            const Model::Vertex& v = mesh.vertices[j];
+            Model::PackedPosition& p = mesh.positions[j];
+            Model::PackedAttributes& a = mesh.attributes[j];
+            glm::vec3 decoded;
+            for (int k = 0; k < 3; ++k) {
+                float q = std::round((v.pos[k] - lo[k]) / extent[k] * 65535.0f);
+                p.pos[k] = static_cast<uint16_t>(std::clamp(q, 0.0f, 65535.0f));
+                decoded[k] = p.pos[k] * mesh.quantization.scale[k] + mesh.quantization.bias[k];
+            }
+            encode_octahedral(v.color, p.normal);
+            a.texCoord[0] = float_to_half(v.texCoord.x);
+            a.texCoord[1] = float_to_half(v.texCoord.y);
+
+            float position = glm::length(decoded - v.pos);
+            error.max_position = std::max(error.max_position, position);
+            squared += double(position) * position;
+            float length = glm::length(v.color);
+            if (length > 0.0f) {
+                float cosine = std::clamp(glm::dot(decode_octahedral(p.normal), v.color / length), -1.0f, 1.0f);
+                error.max_normal_degrees = std::max(error.max_normal_degrees, std::acos(cosine) * 57.2957795f);
+            }
+            error.max_texcoord = std::max({error.max_texcoord,
+                                           std::fabs(half_to_float(a.texCoord[0]) - v.texCoord.x),
+                                           std::fabs(half_to_float(a.texCoord[1]) - v.texCoord.y)});
+        }
+        if (!mesh.vertices.empty()) {
+            error.rms_position = static_cast<float>(std::sqrt(squared / mesh.vertices.size()));
+        }
+        return error;
+    }
+
+    // Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics": sum of area weighted
+    // plane quadrics; dividing by weight keeps the error a mean squared distance in model units
+    struct Quadric {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+        double weight;
+    };
+
+    Quadric plane_quadric(glm::vec3 n, float d, float weight) {
+        double a = n.x, b = n.y, c = n.z, e = d, w = weight;
+        return {w * a * a, w * a * b, w * a * c, w * a * e, w * b * b, w * b * c, w * b * e, w * c * c, w * c * e, w * e * e, w};
+    }
+
+    Quadric add_quadrics(const Quadric& q, const Quadric& r) {
+        return {q.a2 + r.a2, q.ab + r.ab, q.ac + r.ac, q.ad + r.ad, q.b2 + r.b2, q.bc + r.bc, q.bd + r.bd,
+                q.c2 + r.c2, q.cd + r.cd, q.d2 + r.d2, q.weight + r.weight};
+    }
+
+    double quadric_error(const Quadric& q, glm::vec3 p) {
+        double x = p.x, y = p.y, z = p.z;
+        double e = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z + q.d2
+                 + 2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z + q.ad * x + q.bd * y + q.cd * z);
+        return q.weight > 0.0 ? std::max(e, 0.0) / q.weight : 0.0;
+    }
+
+    // welded[v]: the first vertex with v's exact position. vertices split for UV seams or normal creases
+    // share one welded id, so the simplifier sees the surface as connected there.
+    std::vector<uint32_t> weld_positions(const Model::Mesh& mesh) {
+        std::vector<uint32_t> order(mesh.vertices.size());
+        for (size_t j = 0; j < order.size(); ++j) {
+            order[j] = static_cast<uint32_t>(j);
+        }
+        auto less = [&](uint32_t a, uint32_t b) {
+            const glm::vec3& p = mesh.vertices[a].pos;
+            const glm::vec3& q = mesh.vertices[b].pos;
+            return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z != q.z ? p.z < q.z : a < b;
+        };
+        std::sort(order.begin(), order.end(), less);
+        std::vector<uint32_t> welded(mesh.vertices.size());
+        for (size_t j = 0; j < order.size(); ++j) {
+            bool same = j > 0 && mesh.vertices[order[j - 1]].pos == mesh.vertices[order[j]].pos;
+            welded[order[j]] = same ? welded[order[j - 1]] : order[j];
+        }
+        return welded;
+    }
+
+    // vertices the simplifier never moves: UV seams and normal creases (several vertices at one
+    // position) and material boundaries (one position in several draw ranges)
+    template <typename Index>
+    std::vector<uint8_t> lock_seams(const Model::Mesh& mesh, const std::vector<Index>& indices, const std::vector<uint32_t>& welded) {
+        const uint32_t NONE = UINT32_MAX, SHARED = UINT32_MAX - 1;
+        std::vector<uint32_t> vertices_at(mesh.vertices.size(), 0);
+        for (uint32_t w : welded) {
+            vertices_at[w]++;
+        }
+        std::vector<uint32_t> draw_of(mesh.vertices.size(), NONE);
+        const Model::LodLevel& base = mesh.lods[0];
+        for (uint32_t d = base.firstDraw; d < base.firstDraw + base.drawCount; ++d) {
+            const Model::DrawRange& draw = mesh.draws[d];
+            for (size_t j = draw.firstIndex; j < draw.firstIndex + static_cast<size_t>(draw.indexCount) && j < indices.size(); ++j) {
+                uint32_t& owner = draw_of[welded[indices[j]]];
+                owner = owner == NONE || owner == d ? d : SHARED;
+            }
+        }
+        std::vector<uint8_t> locked(mesh.vertices.size());
+        for (size_t v = 0; v < locked.size(); ++v) {
+            locked[v] = vertices_at[welded[v]] > 1 || draw_of[welded[v]] == SHARED;
+        }
+        return locked;
+    }
+
+    struct SimplifyScratch {
+        std::vector<int32_t> global_to_local;  // -1 outside the range being simplified
+        std::vector<uint32_t> border;          // per welded id: the range stamp whose border it lies on
+        uint32_t stamp = 0;
+    };
+
+    // edge collapse of one draw range onto existing vertices, so every level shares the vertex buffer.
+    // collapses the cheapest independent edges pass by pass until target_index_count or max_error is
+    // reached; never moves locked vertices or vertices on the range's open edges, and rejects collapses
+    // that fold a triangle over. returns the largest collapse error, as a distance in model units.
+    template <typename Index>
+    float simplify_range(const Model::Mesh& mesh, const std::vector<uint32_t>& welded, const std::vector<uint8_t>& seams,
+                         std::vector<Index>& triangles, size_t target_index_count, float max_error, SimplifyScratch& scratch) {
+        size_t index_count = triangles.size() - triangles.size() % 3;
+        std::vector<Index> local_to_global;
+        std::vector<uint32_t> local(index_count);
+        for (size_t j = 0; j < index_count; ++j) {
+            int32_t& id = scratch.global_to_local[triangles[j]];
+            if (id < 0) {
+                id = static_cast<int32_t>(local_to_global.size());
+                local_to_global.push_back(triangles[j]);
+            }
+            local[j] = static_cast<uint32_t>(id);
+        }
+        for (Index v : local_to_global) {
+            scratch.global_to_local[v] = -1;
+        }
+        size_t vertex_count = local_to_global.size();
+
+        // edges without exactly two triangles in the welded topology: open borders and material boundaries
+        std::vector<uint64_t> edges;
+        edges.reserve(index_count);
+        for (size_t j = 0; j < index_count; ++j) {
+            uint64_t a = welded[local_to_global[local[j]]];
+            uint64_t b = welded[local_to_global[local[j - j % 3 + (j + 1) % 3]]];
+            if (a != b) {
+                edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        scratch.stamp++;
+        for (size_t j = 0; j < edges.size();) {
+            size_t k = j;
+            while (k < edges.size() && edges[k] == edges[j]) {
+                k++;
+            }
+            if (k - j != 2) {
+                scratch.border[edges[j] >> 32] = scratch.stamp;
+                scratch.border[edges[j] & 0xFFFFFFFFu] = scratch.stamp;
+            }
+            j = k;
+        }
+
+        std::vector<glm::vec3> positions(vertex_count);
+        std::vector<uint8_t> locked(vertex_count);
+        std::vector<Quadric> quadrics(vertex_count, Quadric{});
+        for (size_t v = 0; v < vertex_count; ++v) {
+            Index g = local_to_global[v];
+            positions[v] = mesh.vertices[g].pos;
+            locked[v] = seams[g] || scratch.border[welded[g]] == scratch.stamp;
+        }
+        for (size_t t = 0; t < index_count; t += 3) {
+            glm::vec3 a = positions[local[t]], b = positions[local[t + 1]], c = positions[local[t + 2]];
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float length = glm::length(n);
+            if (length == 0.0f) {
+                continue;
+            }
+            n /= length;
+            Quadric q = plane_quadric(n, -glm::dot(n, a), length * 0.5f);
+            for (int k = 0; k < 3; ++k) {
+                quadrics[local[t + k]] = add_quadrics(quadrics[local[t + k]], q);
+            }
+        }
+
+        struct Collapse { uint32_t from, to; double cost; };
+        std::vector<Collapse> candidates;
+        std::vector<uint32_t> first_adjacent(vertex_count + 1), adjacency, collapse(vertex_count);
+        std::vector<uint8_t> touched(vertex_count);
+        double limit = double(max_error) * max_error;
+        double worst = 0.0;
+        while (index_count > target_index_count) {
+            std::fill(first_adjacent.begin(), first_adjacent.end(), 0);
+            for (size_t j = 0; j < index_count; ++j) {
+                first_adjacent[local[j] + 1]++;
+            }
+            for (size_t v = 0; v < vertex_count; ++v) {
+                first_adjacent[v + 1] += first_adjacent[v];
+            }
+            adjacency.resize(index_count);
+            {
+                std::vector<uint32_t> fill(first_adjacent.begin(), first_adjacent.end() - 1);
+                for (size_t j = 0; j < index_count; ++j) {
+                    adjacency[fill[local[j]]++] = static_cast<uint32_t>(j / 3);
+                }
+            }
+
+            candidates.clear();
+            for (size_t j = 0; j < index_count; ++j) {
+                uint32_t a = local[j], b = local[j - j % 3 + (j + 1) % 3];
+                Quadric q = add_quadrics(quadrics[a], quadrics[b]);
+                if (!locked[a]) {
+                    candidates.push_back({a, b, quadric_error(q, positions[b])});
+                }
+                if (!locked[b]) {
+                    candidates.push_back({b, a, quadric_error(q, positions[a])});
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+            std::fill(touched.begin(), touched.end(), 0);
+            for (size_t v = 0; v < vertex_count; ++v) {
+                collapse[v] = static_cast<uint32_t>(v);
+            }
+            size_t remaining = index_count;
+            bool collapsed = false;
+            for (const auto& c : candidates) {
+                if (c.cost > limit || remaining <= target_index_count) {
+                    break;
+                }
+                if (touched[c.from] || touched[c.to]) {
+                    continue;
+                }
+                bool valid = true;
+                size_t degenerate = 0;
+                for (uint32_t a = first_adjacent[c.from]; a < first_adjacent[c.from + 1] && valid; ++a) {
+                    const uint32_t* tri = &local[3 * adjacency[a]];
+                    if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                        degenerate++;
+                        continue;
+                    }
+                    glm::vec3 p[3], q[3];
+                    for (int k = 0; k < 3; ++k) {
+                        p[k] = positions[tri[k]];
+                        q[k] = tri[k] == c.from ? positions[c.to] : p[k];
+                    }
+                    glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                    float lengths = glm::length(before) * glm::length(after);
+                    valid = lengths > 0.0f && glm::dot(before, after) >= 0.25f * lengths;
+                }
+                if (!valid) {
+                    continue;
+                }
+                collapse[c.from] = c.to;
+                quadrics[c.to] = add_quadrics(quadrics[c.to], quadrics[c.from]);
+                worst = std::max(worst, c.cost);
+                // keeps the adjacency and flip tests of this pass exact
+                for (uint32_t a = first_adjacent[c.from]; a < first_adjacent[c.from + 1]; ++a) {
+                    const uint32_t* tri = &local[3 * adjacency[a]];
+                    touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+                }
+                remaining -= 3 * degenerate;
+                collapsed = true;
+            }
+            if (!collapsed) {
+                break;
+            }
+
+            size_t kept = 0;
+            for (size_t t = 0; t < index_count; t += 3) {
+                uint32_t a = collapse[local[t]], b = collapse[local[t + 1]], c = collapse[local[t + 2]];
+                if (a != b && b != c && c != a) {
+                    local[kept++] = a;
+                    local[kept++] = b;
+                    local[kept++] = c;
+                }
+            }
+            index_count = kept;
+        }
+
+        triangles.resize(index_count);
+        for (size_t j = 0; j < index_count; ++j) {
+            triangles[j] = local_to_global[local[j]];
+        }
+        return static_cast<float>(std::sqrt(worst));
+    }
+
+    // appends up to lod_count levels after mesh.lods[0], each simplifying the previous one per material
+    // to lod_ratio of its triangles. a level that cannot drop at least 10% of the triangles ends the chain.
+    template <typename Index>
+    void build_lods(Model::Mesh& mesh, std::vector<Index>& indices, int lod_count, float lod_ratio, float lod_max_error) {
+        if (mesh.lods.empty() || mesh.vertices.empty()) {
+            return;
+        }
+        std::vector<uint32_t> welded = weld_positions(mesh);
+        std::vector<uint8_t> seams = lock_seams(mesh, indices, welded);
+        SimplifyScratch scratch{std::vector<int32_t>(mesh.vertices.size(), -1), std::vector<uint32_t>(mesh.vertices.size(), 0)};
+
+        glm::vec3 lo = mesh.vertices[0].pos, hi = lo;
+        for (const auto& v : mesh.vertices) {
+            lo = glm::min(lo, v.pos);
+            hi = glm::max(hi, v.pos);
+        }
+        float max_error = lod_max_error * glm::length(hi - lo);
+
+        for (int level = 1; level <= lod_count; ++level) {
+            Model::LodLevel previous = mesh.lods.back();
+            Model::LodLevel next{static_cast<uint32_t>(mesh.draws.size()), previous.drawCount, previous.error, 0};
+            size_t before = 0, after = 0;
+            size_t first_new_index = indices.size();
+            float error = 0.0f;
+            for (uint32_t d = previous.firstDraw; d < previous.firstDraw + previous.drawCount; ++d) {
+                Model::DrawRange draw = mesh.draws[d];
+                std::vector<Index> triangles(indices.begin() + draw.firstIndex, indices.begin() + draw.firstIndex + draw.indexCount);
+                size_t target = static_cast<size_t>(triangles.size() / 3 * lod_ratio) * 3;
+                error = std::max(error, simplify_range(mesh, welded, seams, triangles, target, max_error, scratch));
+                before += draw.indexCount;
+                after += triangles.size();
+                mesh.draws.push_back({static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(triangles.size()), draw.texture, draw.material, 0, 0});
+                indices.insert(indices.end(), triangles.begin(), triangles.end());
+            }
+            if (after > before * 0.9) {
+                mesh.draws.resize(next.firstDraw);
+                indices.resize(first_new_index);
+                break;
+            }
+            // errors of successive levels add up, as each is measured against the one before
+            next.error += error;
+            std::vector<Model::DrawRange> added(mesh.draws.begin() + next.firstDraw, mesh.draws.end());
+            optimize_vertex_cache(indices, added, mesh.vertices.size());
+            mesh.lods.push_back(next);
+        }
+    }
+
+    void build_lods(Model::Mesh& mesh, int lod_count, float lod_ratio, float lod_max_error) {
+        if (mesh.indices.index_size == 2) {
+            build_lods(mesh, mesh.indices.u16, lod_count, lod_ratio, lod_max_error);
+        } else {
+            build_lods(mesh, mesh.indices.u32, lod_count, lod_ratio, lod_max_error);
+        }
+    }
+
+    const size_t MESHLET_MAX_VERTICES = 64;
+    const size_t MESHLET_MAX_TRIANGLES = 124;
+
+    // Ritter's bounding sphere: starts from an approximately farthest pair and grows to cover every point
+    glm::vec4 bounding_sphere(const std::vector<glm::vec3>& points) {
+        auto farthest_from = [&](glm::vec3 p) {
+            glm::vec3 best = p;
+            float distance = -1.0f;
+            for (const auto& q : points) {
+                float d = glm::dot(q - p, q - p);
+                if (d > distance) {
+                    distance = d;
+                    best = q;
+                }
+            }
+            return best;
+        };
+        glm::vec3 a = farthest_from(points[0]);
+        glm::vec3 b = farthest_from(a);
+        glm::vec3 center = (a + b) * 0.5f;
+        float radius = glm::length(b - a) * 0.5f;
+        for (const auto& p : points) {
+            float d = glm::length(p - center);
+            if (d > radius) {
+                float grown = (radius + d) * 0.5f;
+                center += (p - center) * ((grown - radius) / d);
+                radius = grown;
+            }
+        }
+        return glm::vec4(center, radius);
+    }
+
+    // cone around the average of unit triangle normals; w is the sine of the half angle of the cone of
+    // view directions from which every triangle is back facing, or 1 when there is none worth testing
+    glm::vec4 normal_cone(const std::vector<glm::vec3>& normals) {
+        glm::vec3 axis(0.0f);
+        for (const auto& n : normals) {
+            axis += n;
+        }
+        float length = glm::length(axis);
+        if (length == 0.0f) {
+            return glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        }
+        axis /= length;
+        float min_dot = 1.0f;
+        for (const auto& n : normals) {
+            min_dot = std::min(min_dot, glm::dot(n, axis));
+        }
+        // nearly hemispherical cones almost never cull and are not worth the test
+        if (min_dot <= 0.1f) {
+            return glm::vec4(axis, 1.0f);
+        }
+        return glm::vec4(axis, std::sqrt(1.0f - min_dot * min_dot));
+    }
+
+    // splits every DrawRange into runs of consecutive triangles with at most MESHLET_MAX_VERTICES unique
+    // vertices and MESHLET_MAX_TRIANGLES triangles, so each meshlet stays a plain index range for
+    // drawIndexedIndirect. the cache and overdraw passes already made neighbouring triangles local.
+    template <typename Index>
+    void build_meshlets(Model::Mesh& mesh, const std::vector<Index>& indices) {
+        mesh.meshlets.clear();
+        // half a quantization step per axis, since the GPU draws the quantized positions
+        float padding = glm::length(glm::vec3(mesh.quantization.scale)) * 0.5f;
+
+        std::vector<uint32_t> stamp(mesh.vertices.size(), 0);
+        std::vector<glm::vec3> points, normals;
+        for (uint32_t d = 0; d < mesh.draws.size(); ++d) {
+            Model::DrawRange& draw = mesh.draws[d];
+            draw.firstMeshlet = static_cast<uint32_t>(mesh.meshlets.size());
+            draw.meshletCount = 0;
+            size_t end = draw.firstIndex + static_cast<size_t>(draw.indexCount - draw.indexCount % 3);
+            if (end > indices.size()) {
+                continue;
+            }
+
+            size_t first = draw.firstIndex;
+            // meshlet n owns the vertices stamped n + 1
+            auto current = [&] { return static_cast<uint32_t>(mesh.meshlets.size() + 1); };
+            auto new_vertices = [&](const Index* tri) {
+                size_t count = 0;
+                for (int k = 0; k < 3; ++k) {
+                    bool repeated = (k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]);
+                    if (stamp[tri[k]] != current() && !repeated) {
+                        count++;
+                    }
+                }
+                return count;
+            };
+            auto flush = [&](size_t last) {
+                if (last == first) {
+                    return;
+                }
+                glm::vec4 sphere = bounding_sphere(points);
+                sphere.w += padding;
+                mesh.meshlets.push_back({sphere, normal_cone(normals), static_cast<uint32_t>(first), static_cast<uint32_t>(last - first), d, draw.firstMeshlet});
+                points.clear();
+                normals.clear();
+                first = last;
+            };
+
+            for (size_t t = first; t < end; t += 3) {
+                const Index* tri = &indices[t];
+                if (points.size() + new_vertices(tri) > MESHLET_MAX_VERTICES || (t - first) / 3 == MESHLET_MAX_TRIANGLES) {
+                    flush(t);
+                }
+                for (int k = 0; k < 3; ++k) {
+                    if (stamp[tri[k]] != current()) {
+                        stamp[tri[k]] = current();
+                        points.push_back(mesh.vertices[tri[k]].pos);
+                    }
+                }
+                // the geometric normal faces the viewer for the model pass's front faces (counter-clockwise
+                // through the flipped projection); the authored vertex normals do not guarantee that
+                glm::vec3 a = mesh.vertices[tri[0]].pos, b = mesh.vertices[tri[1]].pos, c = mesh.vertices[tri[2]].pos;
+                glm::vec3 n = glm::cross(b - a, c - a);
+                float length = glm::length(n);
+                if (length > 0.0f) {
+                    normals.push_back(n / length);
+                }
+            }
+            flush(end);
+            draw.meshletCount = static_cast<uint32_t>(mesh.meshlets.size()) - draw.firstMeshlet;
+        }
+    }
+
+    void build_meshlets(Model::Mesh& mesh) {
+        if (mesh.indices.index_size == 2) {
+            build_meshlets(mesh, mesh.indices.u16);
+        } else {
+            build_meshlets(mesh, mesh.indices.u32);
+        }
+    }
+
+    // share of triangles whose meshlet the backface cone test rejects, averaged over view_count cameras
+    // spread over a sphere of twice the model's radius, as cull_meshlets.comp tests them
+    double estimate_cone_culling(const Model::Mesh& mesh, int view_count = 12) {
+        if (mesh.meshlets.empty()) {
+            return 0.0;
+        }
+        glm::vec3 lo = mesh.vertices[0].pos, hi = lo;
+        for (const auto& v : mesh.vertices) {
+            lo = glm::min(lo, v.pos);
+            hi = glm::max(hi, v.pos);
+        }
+        glm::vec3 center = (lo + hi) * 0.5f;
+        float distance = std::max(glm::length(hi - lo), 1e-6f);
+
+        size_t total = 0;
+        for (const auto& m : mesh.meshlets) {
+            total += m.indexCount / 3;
+        }
+        double culled = 0.0;
+        for (int view = 0; view < view_count; ++view) {
+            float z = 1.0f - (2.0f * view + 1.0f) / view_count;
+            float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            float phi = view * 2.39996323f;
+            glm::vec3 camera = center + glm::vec3(r * std::cos(phi), r * std::sin(phi), z) * distance;
+            size_t rejected = 0;
+            for (const auto& m : mesh.meshlets) {
+                glm::vec3 d = glm::vec3(m.sphere) - camera;
+                if (glm::dot(d, glm::vec3(m.cone)) >= m.cone.w * glm::length(d) + m.sphere.w) {
+                    rejected += m.indexCount / 3;
+                }
+            }
+            culled += total ? double(rejected) / total : 0.0;
+        }
+        return culled / view_count;
+    }
+
+    struct Options {
+        // overdraw pass: clusters may cost up to threshold times the range's ACMR; <= 0 skips the pass
+        float overdraw_threshold = 1.05f;
+        // level of detail chain: up to lod_count levels after the authored mesh, each keeping lod_ratio of the
+        // previous level's triangles and adding at most lod_max_error (relative to the mesh's extent) of error
+        int lod_count = 3;
+        float lod_ratio = 0.5f;
+        float lod_max_error = 0.02f;
+    };
+
+    // runs every pass, reports what each one saved and packs the result for upload
+    void optimize(Model::Mesh& mesh, const Options& options = {}) {
+        DedupStats dedup = deduplicate_vertices(mesh);
+        size_t removed = dedup.vertices_before - dedup.vertices_after;
+        size_t saved_bytes = removed * (sizeof(Model::PackedPosition) + sizeof(Model::PackedAttributes)) + (dedup.index_bytes_before - dedup.index_bytes_after);
+        // the model and edge passes each shade every unique vertex at least once
+        std::cout << "dedup: " << dedup.vertices_before << " -> " << dedup.vertices_after << " vertices, "
+                  << saved_bytes / 1024.0 << " KB VRAM and at least " << 2 * removed
+                  << " vertex shader invocations per frame saved" << std::endl;
+
+        CacheStats before = analyze_vertex_cache(mesh);
+        PMXLoader::FaceIndices original = mesh.indices;
+        optimize_vertex_cache(mesh);
+        CacheStats after = analyze_vertex_cache(mesh);
+        if (after.acmr > before.acmr) {
+            // already cache friendly (e.g. strip ordered); keep the authored order
+            mesh.indices = std::move(original);
+            after = before;
+        }
+        // both the model and the edge pass draw every index, so each miss saved counts twice per frame
+        double misses_saved = 2 * (before.acmr - after.acmr) * (mesh.indices.size() / 3);
+        std::cout << "vertex cache: ACMR " << before.acmr << " -> " << after.acmr
+                  << ", ATVR " << before.atvr << " -> " << after.atvr
+                  << ", " << misses_saved << " vertex shader invocations per frame saved" << std::endl;
+
+        if (options.overdraw_threshold > 0.0f) {
+            double overdraw_before = estimate_overdraw(mesh);
+            optimize_overdraw(mesh, options.overdraw_threshold);
+            double overdraw_after = estimate_overdraw(mesh);
+            CacheStats clustered = analyze_vertex_cache(mesh);
+            std::cout << "overdraw: " << overdraw_before << " -> " << overdraw_after
+                      << " (ACMR " << after.acmr << " -> " << clustered.acmr << ")" << std::endl;
+        }
+
+        std::pair<double, double> fetch = mesh.indices.index_size == 2
+            ? optimize_vertex_fetch_if_better(mesh.vertices, mesh.indices.u16)
+            : optimize_vertex_fetch_if_better(mesh.vertices, mesh.indices.u32);
+        std::cout << "vertex fetch: efficiency " << fetch.first << " -> " << fetch.second << std::endl;
+
+        QuantizationError error = quantize_vertices(mesh);
+        std::cout << "quantize: " << sizeof(Model::Vertex) << " -> " << sizeof(Model::PackedPosition) << " + " << sizeof(Model::PackedAttributes) << " bytes per vertex, "
+                  << "position error max " << error.max_position << " rms " << error.rms_position
+                  << ", normal error max " << error.max_normal_degrees << " deg"
+                  << ", uv error max " << error.max_texcoord << std::endl;
+
+        size_t base_indices = mesh.indices.size();
+        build_lods(mesh, options.lod_count, options.lod_ratio, options.lod_max_error);
+        std::cout << "lod: " << mesh.lods.size() << " levels, triangles";
+        for (const auto& lod : mesh.lods) {
+            size_t triangles = 0;
+            for (uint32_t d = lod.firstDraw; d < lod.firstDraw + lod.drawCount; ++d) {
+                triangles += mesh.draws[d].indexCount / 3;
+            }
+            std::cout << " " << triangles << " (error " << lod.error << ")";
+        }
+        std::cout << ", +" << (mesh.indices.size() - base_indices) * mesh.indices.index_size / 1024.0 << " KB indices" << std::endl;
+
+        build_meshlets(mesh);
+        size_t meshlet_vertices = 0;
+        std::vector<uint32_t> stamp(mesh.vertices.size(), 0);
+        for (uint32_t j = 0; j < mesh.meshlets.size(); ++j) {
+            const Model::Meshlet& m = mesh.meshlets[j];
+            for (uint32_t k = 0; k < m.indexCount; ++k) {
+                uint32_t v = mesh.indices[m.firstIndex + k];
+                if (stamp[v] != j + 1) {
+                    stamp[v] = j + 1;
+                    meshlet_vertices++;
+                }
+            }
+        }
+        size_t meshlet_count = std::max<size_t>(mesh.meshlets.size(), 1);
+        std::cout << "meshlets: " << mesh.meshlets.size() << ", " << double(meshlet_vertices) / meshlet_count << " vertices and "
+                  << double(mesh.indices.size() / 3) / meshlet_count << " triangles on average, backface cones reject "
+                  << 100.0 * estimate_cone_culling(mesh) << "% of triangles" << std::endl;
+    }
+
+}
+
+#endif
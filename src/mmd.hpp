@@ -1,13 +1,35 @@
+#ifndef MMD_INCLUDED
+#define MMD_INCLUDED
+
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <array>
-#include <codecvt>  // deprecated
 #include <string>
+#include <string_view>
 #include <ios>
 #include <locale>
 #include <filesystem>
 #include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <exception>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+#if defined(__SSE2__) && defined(__GNUC__)
+#   include <tmmintrin.h>
+#   define MMD_SSSE3_DISPATCH
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace PMXLoader {
 
@@ -65,15 +87,1190 @@ namespace PMXLoader {
         int number_of_plane;
     };
 
+    struct PMXHeader {
+        float version;
+        PMXProperty property;
+        std::string model_name;
+        std::string model_name_en;
+        std::string comment;
+        std::string comment_en;
+    };
+
+    enum DeformType : uint8_t {
+        BDEF1 = 0,
+        BDEF2 = 1,
+        BDEF4 = 2,
+        SDEF = 3,
+        QDEF = 4,  // PMX 2.1
+    };
+
+    // per-vertex data in structure-of-arrays form
+    struct VertexStreams {
+        std::vector<Vertex> vertices;
+        int number_of_additional_uv = 0;
+        std::vector<float4> additional_uv;  // slot k of vertex j at [k * vertices.size() + j]; empty without additional UVs
+
+        // skinning. every vertex gets 4 bone slots; unused slots have index -1 and weight 0.
+        int bone_index_size = 0;
+        std::vector<uint8_t> deform_type;     // DeformType
+        std::vector<uint8_t> bone_indices;    // 4 signed little-endian indices of bone_index_size bytes per vertex
+        std::vector<float4> bone_weights;
+        std::vector<float3> sdef_c;           // SDEF parameters, zero for other deform types; empty without SDEF vertices
+        std::vector<float3> sdef_r0;
+        std::vector<float3> sdef_r1;
+
+        // bone_indices viewed as int8_t/int16_t/int32_t quads; T must match bone_index_size
+        template <typename T>
+        const T* bone_index_stream() const {
+            if (sizeof(T) != static_cast<size_t>(bone_index_size)) {
+                throw std::runtime_error("bone index stream is " + std::to_string(bone_index_size) + " bytes wide");
+            }
+            return reinterpret_cast<const T*>(bone_indices.data());
+        }
+
+        int bone_index(size_t vertex, int slot) const {
+            const uint8_t* p = bone_indices.data() + (4 * vertex + slot) * bone_index_size;
+            switch (bone_index_size) {
+                case 1: return static_cast<int8_t>(*p);
+                case 2: { int16_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+                default: { int32_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+            }
+        }
+    };
+
+    // read-only mmap of a whole file
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& filename) {
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error("failed to open file: " + filename);
+            }
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+                ::close(fd);
+                throw std::runtime_error("failed to stat file: " + filename);
+            }
+            void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) {
+                throw std::runtime_error("failed to mmap file: " + filename);
+            }
+            ::madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+            ptr = static_cast<const uint8_t*>(p);
+            length = static_cast<size_t>(st.st_size);
+        }
+
+        ~MappedFile() {
+            if (ptr) {
+                ::munmap(const_cast<uint8_t*>(ptr), length);
+            }
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& other) noexcept : ptr(other.ptr), length(other.length) {
+            other.ptr = nullptr;
+            other.length = 0;
+        }
+
+        const uint8_t* data() const { return ptr; }
+        size_t size() const { return length; }
+
+    private:
+        const uint8_t* ptr = nullptr;
+        size_t length = 0;
+    };
+
+    // bounds-checked little-endian reader over a byte range
+    class ByteCursor {
+    public:
+        ByteCursor(const uint8_t* data, size_t size) : first(data), cur(data), last(data + size) {}
+
+        template <typename T>
+        T read() {
+            require(sizeof(T));
+            T value;
+            std::memcpy(&value, cur, sizeof(T));
+            cur += sizeof(T);
+            return value;
+        }
+
+        void read_bytes(void* dst, size_t n) {
+            std::memcpy(dst, take(n), n);
+        }
+
+        // returns the current position and advances n bytes
+        const uint8_t* take(size_t n) {
+            require(n);
+            const uint8_t* p = cur;
+            cur += n;
+            return p;
+        }
+
+        void skip(size_t n) {
+            require(n);
+            cur += n;
+        }
+
+        void seek(size_t offset) {
+            if (offset > static_cast<size_t>(last - first)) {
+                throw std::runtime_error("PMX seek out of range: " + std::to_string(offset));
+            }
+            cur = first + offset;
+        }
+
+        size_t offset() const { return static_cast<size_t>(cur - first); }
+        size_t remaining() const { return static_cast<size_t>(last - cur); }
+
+    private:
+        const uint8_t* first;
+        const uint8_t* cur;
+        const uint8_t* last;
+
+        void require(size_t n) const {
+            if (n > remaining()) {
+                throw std::runtime_error("unexpected end of PMX data at offset " + std::to_string(offset()));
+            }
+        }
+    };
+
+    // names of bones, morphs, display frames, rigid bodies, joints and soft bodies share one buffer
+    struct StringRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    class StringArena {
+    public:
+        std::string_view get(StringRef ref) const {
+            return std::string_view(data.data() + ref.offset, ref.length);
+        }
+
+        size_t size() const { return data.size(); }
+
+    private:
+        std::string data;
+
+        friend StringRef read_string_to_arena(ByteCursor& in, int is_utf8, StringArena& arena);
+    };
+
+    enum BoneFlag : uint16_t {
+        BONE_TAIL_IS_BONE = 0x0001,
+        BONE_ROTATABLE = 0x0002,
+        BONE_TRANSLATABLE = 0x0004,
+        BONE_VISIBLE = 0x0008,
+        BONE_ENABLED = 0x0010,
+        BONE_IK = 0x0020,
+        BONE_INHERIT_ROTATION = 0x0100,
+        BONE_INHERIT_TRANSLATION = 0x0200,
+        BONE_FIXED_AXIS = 0x0400,
+        BONE_LOCAL_AXIS = 0x0800,
+        BONE_PHYSICS_AFTER_DEFORM = 0x1000,
+        BONE_EXTERNAL_PARENT = 0x2000,
+    };
+
+    struct Bone {
+        StringRef name;
+        StringRef name_en;
+        float3 position;
+        int parent;
+        int layer;
+        uint16_t flags;                 // BoneFlag
+        int tail_bone;                  // BONE_TAIL_IS_BONE
+        float3 tail_offset;             // otherwise
+        int inherit_parent;             // BONE_INHERIT_ROTATION / BONE_INHERIT_TRANSLATION
+        float inherit_weight;
+        float3 fixed_axis;              // BONE_FIXED_AXIS
+        float3 local_x;                 // BONE_LOCAL_AXIS
+        float3 local_z;
+        int external_parent_key;        // BONE_EXTERNAL_PARENT
+        int ik_target;                  // BONE_IK
+        int ik_loop;
+        float ik_limit_angle;
+        uint32_t ik_first_link;         // into PMXModel::ik_links
+        uint32_t ik_link_count;
+    };
+
+    struct IKLink {
+        int bone;
+        bool has_limit;
+        float3 lower_limit;
+        float3 upper_limit;
+    };
+
+    enum MorphType : uint8_t {
+        MORPH_GROUP = 0,
+        MORPH_VERTEX = 1,
+        MORPH_BONE = 2,
+        MORPH_UV = 3,
+        MORPH_ADDITIONAL_UV1 = 4,
+        MORPH_ADDITIONAL_UV2 = 5,
+        MORPH_ADDITIONAL_UV3 = 6,
+        MORPH_ADDITIONAL_UV4 = 7,
+        MORPH_MATERIAL = 8,
+        MORPH_FLIP = 9,      // PMX 2.1
+        MORPH_IMPULSE = 10,  // PMX 2.1
+    };
+
+    // offsets of a morph are a contiguous range in the MorphOffsets array for its type:
+    // group/flip -> group, vertex -> vertex, bone -> bone, uv/additional uv -> uv,
+    // material -> material, impulse -> impulse
+    struct Morph {
+        StringRef name;
+        StringRef name_en;
+        uint8_t panel;
+        uint8_t type;  // MorphType
+        uint32_t first_offset;
+        uint32_t offset_count;
+    };
+
+    struct GroupMorphOffset {
+        int morph;
+        float weight;
+    };
+
+    struct VertexMorphOffset {
+        int vertex;
+        float3 translation;
+    };
+
+    struct BoneMorphOffset {
+        int bone;
+        float3 translation;
+        float4 rotation;
+    };
+
+    struct UVMorphOffset {
+        int vertex;
+        float4 offset;
+    };
+
+    struct MaterialMorphOffset {
+        int material;  // -1: all materials
+        uint8_t operation;  // 0: multiply, 1: add
+        float4 diffuse;
+        float3 specular;
+        float specular_coef;
+        float3 ambient;
+        float4 edge_color;
+        float edge_size;
+        float4 texture_tint;
+        float4 sphere_tint;
+        float4 toon_tint;
+    };
+
+    struct ImpulseMorphOffset {
+        int rigid_body;
+        bool local;
+        float3 velocity;
+        float3 torque;
+    };
+
+    struct MorphOffsets {
+        std::vector<GroupMorphOffset> group;
+        std::vector<VertexMorphOffset> vertex;
+        std::vector<BoneMorphOffset> bone;
+        std::vector<UVMorphOffset> uv;
+        std::vector<MaterialMorphOffset> material;
+        std::vector<ImpulseMorphOffset> impulse;
+    };
+
+    struct DisplayFrame {
+        StringRef name;
+        StringRef name_en;
+        bool special;
+        uint32_t first_element;  // into PMXModel::display_frame_elements
+        uint32_t element_count;
+    };
+
+    struct DisplayFrameElement {
+        uint8_t type;  // 0: bone, 1: morph
+        int index;
+    };
+
+    struct RigidBody {
+        StringRef name;
+        StringRef name_en;
+        int bone;
+        uint8_t group;
+        uint16_t non_collision_mask;
+        uint8_t shape;  // 0: sphere, 1: box, 2: capsule
+        float3 size;
+        float3 position;
+        float3 rotation;
+        float mass;
+        float linear_damping;
+        float angular_damping;
+        float restitution;
+        float friction;
+        uint8_t physics_mode;  // 0: follow bone, 1: physics, 2: physics + bone position
+    };
+
+    struct Joint {
+        StringRef name;
+        StringRef name_en;
+        uint8_t type;  // 0: spring 6dof (PMX 2.1 adds 1..5)
+        int rigid_body_a;
+        int rigid_body_b;
+        float3 position;
+        float3 rotation;
+        float3 linear_lower_limit;
+        float3 linear_upper_limit;
+        float3 angular_lower_limit;
+        float3 angular_upper_limit;
+        float3 linear_spring;
+        float3 angular_spring;
+    };
+
+    // PMX 2.1
+    struct SoftBody {
+        StringRef name;
+        StringRef name_en;
+        uint8_t shape;  // 0: tri mesh, 1: rope
+        int material;
+        uint8_t group;
+        uint16_t non_collision_mask;
+        uint8_t flags;
+        int b_link_distance;
+        int cluster_count;
+        float total_mass;
+        float collision_margin;
+        int aero_model;
+        float config[12];     // VCF DP DG LF PR VC DF MT CHR KHR SHR AHR
+        float cluster[6];     // SRHR_CL SKHR_CL SSHR_CL SR_SPLT_CL SK_SPLT_CL SS_SPLT_CL
+        int iteration[4];     // V_IT P_IT D_IT C_IT
+        float material_coef[3];  // LST AST VST
+        uint32_t first_anchor;   // into PMXModel::soft_body_anchors
+        uint32_t anchor_count;
+        uint32_t first_pin;      // into PMXModel::soft_body_pins
+        uint32_t pin_count;
+    };
+
+    struct SoftBodyAnchor {
+        int rigid_body;
+        int vertex;
+        bool near_mode;
+    };
+
+    // face indices widened to the smallest type that addresses every vertex;
+    // exactly one of u16/u32 is filled, selected by index_size
+    struct FaceIndices {
+        int index_size = 2;  // 2 or 4
+        std::vector<uint16_t> u16;
+        std::vector<uint32_t> u32;
+
+        size_t size() const { return index_size == 2 ? u16.size() : u32.size(); }
+        uint32_t operator[](size_t j) const { return index_size == 2 ? u16[j] : u32[j]; }
+    };
+
+    // every section read_pmx_model decodes
+    struct PMXModel {
+        PMXHeader header;
+        VertexStreams vertex;
+        FaceIndices planes;
+        std::vector<std::filesystem::path> textures;
+        std::vector<Material> materials;
+
+        StringArena names;
+        std::vector<Bone> bones;
+        std::vector<IKLink> ik_links;
+        std::vector<Morph> morphs;
+        MorphOffsets morph_offsets;
+        std::vector<DisplayFrame> display_frames;
+        std::vector<DisplayFrameElement> display_frame_elements;
+        std::vector<RigidBody> rigid_bodies;
+        std::vector<Joint> joints;
+        std::vector<SoftBody> soft_bodies;
+        std::vector<SoftBodyAnchor> soft_body_anchors;
+        std::vector<int> soft_body_pins;
+    };
+
+    // bone/texture/material/morph/rigid body index (signed, -1 = none)
+    int read_index_from_pmx(ByteCursor& in, int size) {
+        switch (size) {
+            case 1: return static_cast<int>(in.read<int8_t>());
+            case 2: return static_cast<int>(in.read<int16_t>());
+            case 4: return static_cast<int>(in.read<int32_t>());
+            default: throw std::runtime_error("invalid index size: " + std::to_string(size));
+        }
+    }
+
+    // vertex index (unsigned for 1 and 2 byte widths)
+    int read_vertex_index_from_pmx(ByteCursor& in, int size) {
+        switch (size) {
+            case 1: return static_cast<int>(in.read<uint8_t>());
+            case 2: return static_cast<int>(in.read<uint16_t>());
+            case 4: return static_cast<int>(in.read<int32_t>());
+            default: throw std::runtime_error("invalid vertex index size: " + std::to_string(size));
+        }
+    }
+
+    int read_count_from_pmx(ByteCursor& in) {
+        int count = in.read<int32_t>();
+        if (count < 0) {
+            throw std::runtime_error("negative element count at offset " + std::to_string(in.offset() - sizeof(int32_t)));
+        }
+        return count;
+    }
+
+    // byte size of the weight block following the deform type byte
+    size_t weight_block_size(uint8_t weight_transformation, int bone_index_size) {
+        switch (weight_transformation) {
+            case 0://BDEF1
+                return bone_index_size;
+            case 1://BDEF2
+                return 2 * bone_index_size + sizeof(float);
+            case 2://BDEF4
+            case 4://QDEF
+                return 4 * bone_index_size + 4 * sizeof(float);
+            case 3://SDEF
+                return 2 * bone_index_size + sizeof(float) + 3 * sizeof(float3);
+            default:
+                throw std::runtime_error("unknown wt: " + std::to_string(static_cast<int>(weight_transformation)));
+        }
+    }
+
+    // decodes vertex j into every stream of streams (all of which are already sized)
+    void read_vertex_from_pmx(ByteCursor& in, const PMXProperty& property, VertexStreams& streams, size_t j) {
+        const size_t number_of_vertex = streams.vertices.size();
+        const int bone_index_size = property.bone_index_size;
+
+        in.read_bytes(&streams.vertices[j], sizeof(Vertex));
+        if (!streams.additional_uv.empty()) {
+            for (int k = 0; k < property.additional_uv; ++k) {
+                streams.additional_uv[k * number_of_vertex + j] = in.read<float4>();
+            }
+        } else {
+            in.skip(property.additional_uv * sizeof(float4));
+        }
+
+        uint8_t weight_transformation = in.read<uint8_t>();
+        streams.deform_type[j] = weight_transformation;
+        uint8_t* indices = &streams.bone_indices[4 * j * bone_index_size];
+        float4& weights = streams.bone_weights[j];
+        switch (weight_transformation) {
+            case BDEF1:
+                in.read_bytes(indices, bone_index_size);
+                std::memset(indices + bone_index_size, 0xFF, 3 * bone_index_size);
+                weights = {1.0f, 0.0f, 0.0f, 0.0f};
+                break;
+            case BDEF2:
+            case SDEF: {
+                in.read_bytes(indices, 2 * bone_index_size);
+                std::memset(indices + 2 * bone_index_size, 0xFF, 2 * bone_index_size);
+                float w = in.read<float>();
+                weights = {w, 1.0f - w, 0.0f, 0.0f};
+                if (weight_transformation == SDEF) {
+                    streams.sdef_c[j] = in.read<float3>();
+                    streams.sdef_r0[j] = in.read<float3>();
+                    streams.sdef_r1[j] = in.read<float3>();
+                }
+                break;
+            }
+            case BDEF4:
+            case QDEF:
+                in.read_bytes(indices, 4 * bone_index_size);
+                weights = in.read<float4>();
+                break;
+            default:
+                throw std::runtime_error("unknown wt: " + std::to_string(static_cast<int>(weight_transformation)));
+        }
+
+        in.skip(sizeof(float)); // edge scale
+    }
+
+#if defined(MMD_SSSE3_DISPATCH)
+    // converts leading blocks of 8 units that are all in [0x800, 0xD800) or [0xE000, 0xFFFF], 3 bytes
+    // each, and returns how many units it consumed. built for SSSE3 whatever the compiler flags are;
+    // call it only when the cpu supports it
+    __attribute__((target("ssse3")))
+    size_t utf16le_bmp3_to_utf8_ssse3(const uint8_t* src, size_t n, char*& dst) {
+        size_t j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * j));
+            __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+            __m128i vs = _mm_xor_si128(v, bias);  // unsigned compares via signed ones
+            __m128i below_800 = _mm_cmplt_epi16(vs, _mm_set1_epi16(static_cast<short>(0x0800 ^ 0x8000)));
+            __m128i surrogate = _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xF800))), _mm_set1_epi16(static_cast<short>(0xD800)));
+            if (_mm_movemask_epi8(_mm_or_si128(below_800, surrogate)) != 0) {
+                break;
+            }
+            __m128i hi = _mm_or_si128(_mm_srli_epi16(v, 12), _mm_set1_epi16(0xE0));
+            __m128i mid = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 6), _mm_set1_epi16(0x3F)), _mm_set1_epi16(0x80));
+            __m128i lo = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi16(0x3F)), _mm_set1_epi16(0x80));
+            __m128i hm = _mm_packus_epi16(hi, mid);   // h0..h7 m0..m7
+            __m128i ll = _mm_packus_epi16(lo, lo);    // l0..l7 l0..l7
+            const char Z = static_cast<char>(0x80);
+            __m128i out0 = _mm_or_si128(
+                _mm_shuffle_epi8(hm, _mm_setr_epi8(0, 8, Z, 1, 9, Z, 2, 10, Z, 3, 11, Z, 4, 12, Z, 5)),
+                _mm_shuffle_epi8(ll, _mm_setr_epi8(Z, Z, 0, Z, Z, 1, Z, Z, 2, Z, Z, 3, Z, Z, 4, Z)));
+            __m128i out1 = _mm_or_si128(
+                _mm_shuffle_epi8(hm, _mm_setr_epi8(13, Z, 6, 14, Z, 7, 15, Z, Z, Z, Z, Z, Z, Z, Z, Z)),
+                _mm_shuffle_epi8(ll, _mm_setr_epi8(Z, 5, Z, Z, 6, Z, Z, 7, Z, Z, Z, Z, Z, Z, Z, Z)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), out0);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 16), out1);
+            dst += 24;
+        }
+        return j;
+    }
+#endif
+
+    // appends the UTF-8 form of n UTF-16LE code units read from src.
+    // blocks of 8 ASCII units (SSE2) and, on cpus with SSSE3, runs of 8 three-byte BMP units are
+    // converted in one SIMD step; everything else, including surrogate pairs, takes the scalar path.
+    // unpaired surrogates become U+FFFD.
+    void utf16le_to_utf8(const uint8_t* src, size_t n, std::string& out) {
+#if defined(MMD_SSSE3_DISPATCH)
+        static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+        size_t start = out.size();
+        out.resize(start + 3 * n);  // worst case: 3 bytes per unit (a surrogate pair is 2 units -> 4 bytes)
+        char* dst = out.data() + start;
+
+        auto unit = [src](size_t j) -> uint32_t {
+            return static_cast<uint32_t>(src[2 * j]) | (static_cast<uint32_t>(src[2 * j + 1]) << 8);
+        };
+
+        size_t j = 0;
+        while (j < n) {
+#if defined(__SSE2__)
+            if (j + 8 <= n) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * j));
+                __m128i zero = _mm_setzero_si128();
+                // all units < 0x80
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xFF80))), zero)) == 0xFFFF) {
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(v, v));
+                    dst += 8;
+                    j += 8;
+                    continue;
+                }
+#if defined(MMD_SSSE3_DISPATCH)
+                if (has_ssse3) {
+                    size_t converted = utf16le_bmp3_to_utf8_ssse3(src + 2 * j, n - j, dst);
+                    if (converted != 0) {
+                        j += converted;
+                        continue;
+                    }
+                }
+#endif
+            }
+#endif
+            uint32_t c = unit(j++);
+            if (c < 0x80) {
+                *dst++ = static_cast<char>(c);
+            } else if (c < 0x800) {
+                *dst++ = static_cast<char>(0xC0 | (c >> 6));
+                *dst++ = static_cast<char>(0x80 | (c & 0x3F));
+            } else if ((c & 0xF800) != 0xD800) {
+                *dst++ = static_cast<char>(0xE0 | (c >> 12));
+                *dst++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                *dst++ = static_cast<char>(0x80 | (c & 0x3F));
+            } else if (c < 0xDC00 && j < n && (unit(j) & 0xFC00) == 0xDC00) {
+                uint32_t cp = 0x10000 + ((c - 0xD800) << 10) + (unit(j++) - 0xDC00);
+                *dst++ = static_cast<char>(0xF0 | (cp >> 18));
+                *dst++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                *dst++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                *dst++ = static_cast<char>(0x80 | (cp & 0x3F));
+            } else {
+                *dst++ = static_cast<char>(0xEF);
+                *dst++ = static_cast<char>(0xBF);
+                *dst++ = static_cast<char>(0xBD);
+            }
+        }
+
+        out.resize(static_cast<size_t>(dst - out.data()));
+    }
+
+    // decodes a PMX text field directly from the mapped bytes (UTF-16LE or UTF-8 per header)
+    std::string read_wstring_from_pmx(ByteCursor& in, int is_utf8) {
+        int size = read_count_from_pmx(in);
+        const uint8_t* bytes = in.take(size);
+
+        std::string output;
+        if (is_utf8) {
+            output.assign(reinterpret_cast<const char*>(bytes), size);
+        } else {
+            utf16le_to_utf8(bytes, size / 2, output);
+        }
+        return output;
+    }
+
+    PMXHeader read_header_from_pmx(ByteCursor& in) {
+        const uint8_t* magic = in.take(4);
+        if (std::memcmp(magic, "PMX ", 4) != 0) {
+            throw std::runtime_error("not a PMX file");
+        }
+
+        PMXHeader header;
+        header.version = in.read<float>();
+        uint8_t property_size = in.read<uint8_t>();  // PMX2.0 -> 8
+        if (property_size < 8) {
+            throw std::runtime_error("invalid PMX property size: " + std::to_string(property_size));
+        }
+        const uint8_t* properties = in.take(property_size);
+        header.property = {
+            static_cast<int>(properties[0]),
+            static_cast<int>(properties[1]),
+            static_cast<int>(properties[2]),
+            static_cast<int>(properties[3]),
+            static_cast<int>(properties[4]),
+            static_cast<int>(properties[5]),
+            static_cast<int>(properties[6]),
+            static_cast<int>(properties[7])
+        };
+        for (int size : {header.property.vertex_index_size, header.property.texture_index_size, header.property.material_index_size,
+                         header.property.bone_index_size, header.property.morph_index_size, header.property.rigid_body_index_size}) {
+            if (size != 1 && size != 2 && size != 4) {
+                throw std::runtime_error("invalid PMX index size: " + std::to_string(size));
+            }
+        }
+        header.model_name = read_wstring_from_pmx(in, header.property.is_utf8);
+        header.model_name_en = read_wstring_from_pmx(in, header.property.is_utf8);
+        header.comment = read_wstring_from_pmx(in, header.property.is_utf8);
+        header.comment_en = read_wstring_from_pmx(in, header.property.is_utf8);
+        return header;
+    }
+
+    // vertices decoded per block; also the unit of work for the parallel decoder
+    const size_t VERTEX_BLOCK_SIZE = 4096;
+
+    // runs f(block) for every block in [0, number_of_block) on all hardware threads
+    template <typename F>
+    void parallel_for_blocks(size_t number_of_block, F&& f) {
+        size_t number_of_thread = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), number_of_block);
+        if (number_of_thread <= 1) {
+            for (size_t b = 0; b < number_of_block; ++b) {
+                f(b);
+            }
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        std::exception_ptr error;
+        std::atomic<bool> failed{false};
+        auto worker = [&] {
+            try {
+                for (size_t b = next++; b < number_of_block && !failed; b = next++) {
+                    f(b);
+                }
+            } catch (...) {
+                if (!failed.exchange(true)) {
+                    error = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(number_of_thread - 1);
+        for (size_t t = 1; t < number_of_thread; ++t) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& t : threads) {
+            t.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    struct VertexScan {
+        std::vector<size_t> block_offsets;
+        bool has_sdef = false;
+    };
+
+    // phase 1: walks the variable-length vertex chunks and records where every
+    // VERTEX_BLOCK_SIZE-th vertex starts. only the deform type byte is read.
+    // leaves the cursor after the vertex section.
+    VertexScan scan_vertex_blocks(ByteCursor& in, int number_of_vertex, const PMXProperty& property) {
+        const size_t prefix = sizeof(Vertex) + property.additional_uv * sizeof(float4);
+        VertexScan scan;
+        scan.block_offsets.reserve(number_of_vertex / VERTEX_BLOCK_SIZE + 1);
+        for (int j = 0; j < number_of_vertex; ++j) {
+            if (j % VERTEX_BLOCK_SIZE == 0) {
+                scan.block_offsets.push_back(in.offset());
+            }
+            in.skip(prefix);
+            uint8_t weight_transformation = in.read<uint8_t>();
+            scan.has_sdef |= weight_transformation == SDEF;
+            in.skip(weight_block_size(weight_transformation, property.bone_index_size) + sizeof(float));
+        }
+        return scan;
+    }
+
+    // phase 2: decodes the blocks in parallel straight into the preallocated streams
+    VertexStreams read_vertices_from_pmx(ByteCursor& in, const PMXProperty& property) {
+        int number_of_vertex = read_count_from_pmx(in);
+        VertexScan scan = scan_vertex_blocks(in, number_of_vertex, property);
+
+        VertexStreams streams;
+        streams.vertices.resize(number_of_vertex);
+        streams.number_of_additional_uv = property.additional_uv;
+        streams.additional_uv.resize(static_cast<size_t>(property.additional_uv) * number_of_vertex);
+        streams.bone_index_size = property.bone_index_size;
+        streams.deform_type.resize(number_of_vertex);
+        streams.bone_indices.resize(4 * static_cast<size_t>(property.bone_index_size) * number_of_vertex);
+        streams.bone_weights.resize(number_of_vertex);
+        if (scan.has_sdef) {
+            streams.sdef_c.resize(number_of_vertex);
+            streams.sdef_r0.resize(number_of_vertex);
+            streams.sdef_r1.resize(number_of_vertex);
+        }
+
+        parallel_for_blocks(scan.block_offsets.size(), [&](size_t b) {
+            ByteCursor block = in;
+            block.seek(scan.block_offsets[b]);
+            size_t first = b * VERTEX_BLOCK_SIZE;
+            size_t last = std::min(first + VERTEX_BLOCK_SIZE, streams.vertices.size());
+            for (size_t j = first; j < last; ++j) {
+                read_vertex_from_pmx(block, property, streams, j);
+            }
+        });
+        return streams;
+    }
+
+    // widens n little-endian Src indices into Dst; returns the bits of every index above Dst's range
+    // (1- and 2-byte indices are unsigned in PMX, 4-byte ones are signed and a negative one shows up here too)
+    template <typename Src, typename Dst>
+    uint32_t widen_indices_scalar(const uint8_t* src, Dst* dst, size_t n) {
+        uint32_t overflow = 0;
+        for (size_t j = 0; j < n; ++j) {
+            uint32_t v = 0;
+            for (size_t b = 0; b < sizeof(Src); ++b) {
+                v |= static_cast<uint32_t>(src[j * sizeof(Src) + b]) << (8 * b);
+            }
+            if (sizeof(Dst) < sizeof(uint32_t)) {
+                overflow |= v >> (8 * sizeof(Dst));
+            }
+            dst[j] = static_cast<Dst>(v);
+        }
+        return overflow;
+    }
+
+    template <typename Src, typename Dst>
+    uint32_t widen_indices(const uint8_t* src, Dst* dst, size_t n) {
+        return widen_indices_scalar<Src, Dst>(src, dst, n);
+    }
+
+#if defined(__SSE2__)
+    template <>
+    uint32_t widen_indices<uint8_t, uint16_t>(const uint8_t* src, uint16_t* dst, size_t n) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t j = 0;
+        for (; j + 16 <= n; j += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j), _mm_unpacklo_epi8(v, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j + 8), _mm_unpackhi_epi8(v, zero));
+        }
+        return widen_indices_scalar<uint8_t, uint16_t>(src + j, dst + j, n - j);
+    }
+
+    template <>
+    uint32_t widen_indices<uint8_t, uint32_t>(const uint8_t* src, uint32_t* dst, size_t n) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t j = 0;
+        for (; j + 16 <= n; j += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j), _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j + 4), _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j + 8), _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j + 12), _mm_unpackhi_epi16(hi, zero));
+        }
+        return widen_indices_scalar<uint8_t, uint32_t>(src + j, dst + j, n - j);
+    }
+
+    template <>
+    uint32_t widen_indices<uint16_t, uint16_t>(const uint8_t* src, uint16_t* dst, size_t n) {
+        size_t j = 0;
+        for (; j + 8 <= n; j += 8) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * j)));
+        }
+        return widen_indices_scalar<uint16_t, uint16_t>(src + 2 * j, dst + j, n - j);
+    }
+
+    template <>
+    uint32_t widen_indices<uint16_t, uint32_t>(const uint8_t* src, uint32_t* dst, size_t n) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * j));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j), _mm_unpacklo_epi16(v, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j + 4), _mm_unpackhi_epi16(v, zero));
+        }
+        return widen_indices_scalar<uint16_t, uint32_t>(src + 2 * j, dst + j, n - j);
+    }
+
+    template <>
+    uint32_t widen_indices<uint32_t, uint16_t>(const uint8_t* src, uint16_t* dst, size_t n) {
+        // SSE2 has no unsigned 32->16 pack: bias into the signed range, packs, then unbias
+        const __m128i bias32 = _mm_set1_epi32(0x8000);
+        const __m128i bias16 = _mm_set1_epi16(static_cast<short>(0x8000));
+        __m128i high = _mm_setzero_si128();
+        size_t j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * j));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * j + 16));
+            high = _mm_or_si128(high, _mm_or_si128(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16)));
+            __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j), _mm_add_epi16(packed, bias16));
+        }
+        high = _mm_or_si128(high, _mm_srli_si128(high, 8));
+        high = _mm_or_si128(high, _mm_srli_si128(high, 4));
+        uint32_t overflow = static_cast<uint32_t>(_mm_cvtsi128_si32(high));
+        return overflow | widen_indices_scalar<uint32_t, uint16_t>(src + 4 * j, dst + j, n - j);
+    }
+
+    template <>
+    uint32_t widen_indices<uint32_t, uint32_t>(const uint8_t* src, uint32_t* dst, size_t n) {
+        size_t j = 0;
+        for (; j + 4 <= n; j += 4) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * j)));
+        }
+        return widen_indices_scalar<uint32_t, uint32_t>(src + 4 * j, dst + j, n - j);
+    }
+#endif
+
+    template <typename Dst>
+    void read_planes_as(ByteCursor& in, int vertex_index_size, size_t number_of_vertex, std::vector<Dst>& planes) {
+        const uint8_t* src = in.take(planes.size() * vertex_index_size);
+        uint32_t overflow = 0;
+        switch (vertex_index_size) {
+            case 1: overflow = widen_indices<uint8_t, Dst>(src, planes.data(), planes.size()); break;
+            case 2: overflow = widen_indices<uint16_t, Dst>(src, planes.data(), planes.size()); break;
+            case 4: overflow = widen_indices<uint32_t, Dst>(src, planes.data(), planes.size()); break;
+            default: throw std::runtime_error("invalid vertex index size: " + std::to_string(vertex_index_size));
+        }
+
+        Dst max_index = 0;
+        for (Dst v : planes) {
+            max_index = std::max(max_index, v);
+        }
+        if (overflow != 0 || (!planes.empty() && max_index >= number_of_vertex)) {
+            throw std::runtime_error("face index out of range of " + std::to_string(number_of_vertex) + " vertices");
+        }
+    }
+
+    // decodes the face block in one pass into uint16 when every vertex is addressable by it, uint32 otherwise
+    FaceIndices read_planes_from_pmx(ByteCursor& in, const PMXProperty& property, size_t number_of_vertex) {
+        int number_of_plane = read_count_from_pmx(in);
+        FaceIndices planes;
+        if (number_of_vertex <= 0x10000) {
+            planes.index_size = 2;
+            planes.u16.resize(number_of_plane);
+            read_planes_as(in, property.vertex_index_size, number_of_vertex, planes.u16);
+        } else {
+            planes.index_size = 4;
+            planes.u32.resize(number_of_plane);
+            read_planes_as(in, property.vertex_index_size, number_of_vertex, planes.u32);
+        }
+        return planes;
+    }
+
+    std::vector<std::filesystem::path> read_textures_from_pmx(ByteCursor& in, const PMXProperty& property, const std::filesystem::path& basedir) {
+        int number_of_texture = read_count_from_pmx(in);
+        std::vector<std::filesystem::path> textures(number_of_texture);
+        for (int j = 0; j < number_of_texture; ++j) {
+            std::string p = read_wstring_from_pmx(in, property.is_utf8);
+            std::replace(p.begin(), p.end(), '\\', '/');
+            textures[j] = basedir / std::filesystem::path(p);
+        }
+        return textures;
+    }
+
+    std::vector<Material> read_materials_from_pmx(ByteCursor& in, const PMXProperty& property) {
+        int number_of_material = read_count_from_pmx(in);
+        std::vector<Material> materials(number_of_material);
+        for (auto& m : materials) {
+            m.name = read_wstring_from_pmx(in, property.is_utf8);
+            m.name_en = read_wstring_from_pmx(in, property.is_utf8);
+            m.diffuse = in.read<float4>();
+            m.specular = in.read<float3>();
+            m.specular_coef = in.read<float>();
+            m.ambient = in.read<float3>();
+            m.drawing_mode = in.read<uint8_t>();
+            m.edge_color = in.read<float4>();
+            m.edge_size = in.read<float>();
+            m.normal_texture = read_index_from_pmx(in, property.texture_index_size);
+            m.sphere_texture = read_index_from_pmx(in, property.texture_index_size);
+            m.sphere_mode = in.read<uint8_t>();
+            m.sharing_toon = in.read<uint8_t>() != 0;
+            if (m.sharing_toon) {
+                m.toon_texture = static_cast<int>(in.read<uint8_t>());
+            } else {
+                m.toon_texture = read_index_from_pmx(in, property.texture_index_size);
+            }
+            m.memo = read_wstring_from_pmx(in, property.is_utf8);
+            m.number_of_plane = read_count_from_pmx(in);
+        }
+        return materials;
+    }
+
+    StringRef read_string_to_arena(ByteCursor& in, int is_utf8, StringArena& arena) {
+        int size = read_count_from_pmx(in);
+        const uint8_t* bytes = in.take(size);
+
+        size_t offset = arena.data.size();
+        if (is_utf8) {
+            arena.data.append(reinterpret_cast<const char*>(bytes), size);
+        } else {
+            utf16le_to_utf8(bytes, size / 2, arena.data);
+        }
+        return {static_cast<uint32_t>(offset), static_cast<uint32_t>(arena.data.size() - offset)};
+    }
+
+    uint32_t to_u32(size_t n) {
+        return static_cast<uint32_t>(n);
+    }
+
+    void read_bones_from_pmx(ByteCursor& in, const PMXProperty& property, PMXModel& model) {
+        int number_of_bone = read_count_from_pmx(in);
+        model.bones.resize(number_of_bone);
+        for (auto& b : model.bones) {
+            b = {};
+            b.name = read_string_to_arena(in, property.is_utf8, model.names);
+            b.name_en = read_string_to_arena(in, property.is_utf8, model.names);
+            b.position = in.read<float3>();
+            b.parent = read_index_from_pmx(in, property.bone_index_size);
+            b.layer = in.read<int32_t>();
+            b.flags = in.read<uint16_t>();
+            b.tail_bone = -1;
+            b.inherit_parent = -1;
+            b.ik_target = -1;
+            if (b.flags & BONE_TAIL_IS_BONE) {
+                b.tail_bone = read_index_from_pmx(in, property.bone_index_size);
+            } else {
+                b.tail_offset = in.read<float3>();
+            }
+            if (b.flags & (BONE_INHERIT_ROTATION | BONE_INHERIT_TRANSLATION)) {
+                b.inherit_parent = read_index_from_pmx(in, property.bone_index_size);
+                b.inherit_weight = in.read<float>();
+            }
+            if (b.flags & BONE_FIXED_AXIS) {
+                b.fixed_axis = in.read<float3>();
+            }
+            if (b.flags & BONE_LOCAL_AXIS) {
+                b.local_x = in.read<float3>();
+                b.local_z = in.read<float3>();
+            }
+            if (b.flags & BONE_EXTERNAL_PARENT) {
+                b.external_parent_key = in.read<int32_t>();
+            }
+            if (b.flags & BONE_IK) {
+                b.ik_target = read_index_from_pmx(in, property.bone_index_size);
+                b.ik_loop = in.read<int32_t>();
+                b.ik_limit_angle = in.read<float>();
+                b.ik_first_link = to_u32(model.ik_links.size());
+                b.ik_link_count = read_count_from_pmx(in);
+                for (uint32_t k = 0; k < b.ik_link_count; ++k) {
+                    IKLink link{};
+                    link.bone = read_index_from_pmx(in, property.bone_index_size);
+                    link.has_limit = in.read<uint8_t>() != 0;
+                    if (link.has_limit) {
+                        link.lower_limit = in.read<float3>();
+                        link.upper_limit = in.read<float3>();
+                    }
+                    model.ik_links.push_back(link);
+                }
+            }
+        }
+    }
+
+    void read_morphs_from_pmx(ByteCursor& in, const PMXProperty& property, PMXModel& model) {
+        int number_of_morph = read_count_from_pmx(in);
+        model.morphs.resize(number_of_morph);
+        MorphOffsets& offsets = model.morph_offsets;
+        for (auto& m : model.morphs) {
+            m.name = read_string_to_arena(in, property.is_utf8, model.names);
+            m.name_en = read_string_to_arena(in, property.is_utf8, model.names);
+            m.panel = in.read<uint8_t>();
+            m.type = in.read<uint8_t>();
+            m.offset_count = read_count_from_pmx(in);
+            switch (m.type) {
+                case MORPH_GROUP:
+                case MORPH_FLIP:
+                    m.first_offset = to_u32(offsets.group.size());
+                    for (uint32_t k = 0; k < m.offset_count; ++k) {
+                        GroupMorphOffset o;
+                        o.morph = read_index_from_pmx(in, property.morph_index_size);
+                        o.weight = in.read<float>();
+                        offsets.group.push_back(o);
+                    }
+                    break;
+                case MORPH_VERTEX:
+                    m.first_offset = to_u32(offsets.vertex.size());
+                    for (uint32_t k = 0; k < m.offset_count; ++k) {
+                        VertexMorphOffset o;
+                        o.vertex = read_vertex_index_from_pmx(in, property.vertex_index_size);
+                        o.translation = in.read<float3>();
+                        offsets.vertex.push_back(o);
+                    }
+                    break;
+                case MORPH_BONE:
+                    m.first_offset = to_u32(offsets.bone.size());
+                    for (uint32_t k = 0; k < m.offset_count; ++k) {
+                        BoneMorphOffset o;
+                        o.bone = read_index_from_pmx(in, property.bone_index_size);
+                        o.translation = in.read<float3>();
+                        o.rotation = in.read<float4>();
+                        offsets.bone.push_back(o);
+                    }
+                    break;
+                case MORPH_UV:
+                case MORPH_ADDITIONAL_UV1:
+                case MORPH_ADDITIONAL_UV2:
+                case MORPH_ADDITIONAL_UV3:
+                case MORPH_ADDITIONAL_UV4:
+                    m.first_offset = to_u32(offsets.uv.size());
+                    for (uint32_t k = 0; k < m.offset_count; ++k) {
+                        UVMorphOffset o;
+                        o.vertex = read_vertex_index_from_pmx(in, property.vertex_index_size);
+                        o.offset = in.read<float4>();
+                        offsets.uv.push_back(o);
+                    }
+                    break;
+                case MORPH_MATERIAL:
+                    m.first_offset = to_u32(offsets.material.size());
+                    for (uint32_t k = 0; k < m.offset_count; ++k) {
+                        MaterialMorphOffset o;
+                        o.material = read_index_from_pmx(in, property.material_index_size);
+                        o.operation = in.read<uint8_t>();
+                        o.diffuse = in.read<float4>();
+                        o.specular = in.read<float3>();
+                        o.specular_coef = in.read<float>();
+                        o.ambient = in.read<float3>();
+                        o.edge_color = in.read<float4>();
+                        o.edge_size = in.read<float>();
+                        o.texture_tint = in.read<float4>();
+                        o.sphere_tint = in.read<float4>();
+                        o.toon_tint = in.read<float4>();
+                        offsets.material.push_back(o);
+                    }
+                    break;
+                case MORPH_IMPULSE:
+                    m.first_offset = to_u32(offsets.impulse.size());
+                    for (uint32_t k = 0; k < m.offset_count; ++k) {
+                        ImpulseMorphOffset o;
+                        o.rigid_body = read_index_from_pmx(in, property.rigid_body_index_size);
+                        o.local = in.read<uint8_t>() != 0;
+                        o.velocity = in.read<float3>();
+                        o.torque = in.read<float3>();
+                        offsets.impulse.push_back(o);
+                    }
+                    break;
+                default:
+                    throw std::runtime_error("unknown morph type: " + std::to_string(static_cast<int>(m.type)));
+            }
+        }
+    }
+
+    void read_display_frames_from_pmx(ByteCursor& in, const PMXProperty& property, PMXModel& model) {
+        int number_of_frame = read_count_from_pmx(in);
+        model.display_frames.resize(number_of_frame);
+        for (auto& f : model.display_frames) {
+            f.name = read_string_to_arena(in, property.is_utf8, model.names);
+            f.name_en = read_string_to_arena(in, property.is_utf8, model.names);
+            f.special = in.read<uint8_t>() != 0;
+            f.first_element = to_u32(model.display_frame_elements.size());
+            f.element_count = read_count_from_pmx(in);
+            for (uint32_t k = 0; k < f.element_count; ++k) {
+                DisplayFrameElement e;
+                e.type = in.read<uint8_t>();
+                e.index = read_index_from_pmx(in, e.type == 0 ? property.bone_index_size : property.morph_index_size);
+                model.display_frame_elements.push_back(e);
+            }
+        }
+    }
+
+    void read_rigid_bodies_from_pmx(ByteCursor& in, const PMXProperty& property, PMXModel& model) {
+        int number_of_rigid_body = read_count_from_pmx(in);
+        model.rigid_bodies.resize(number_of_rigid_body);
+        for (auto& r : model.rigid_bodies) {
+            r.name = read_string_to_arena(in, property.is_utf8, model.names);
+            r.name_en = read_string_to_arena(in, property.is_utf8, model.names);
+            r.bone = read_index_from_pmx(in, property.bone_index_size);
+            r.group = in.read<uint8_t>();
+            r.non_collision_mask = in.read<uint16_t>();
+            r.shape = in.read<uint8_t>();
+            r.size = in.read<float3>();
+            r.position = in.read<float3>();
+            r.rotation = in.read<float3>();
+            r.mass = in.read<float>();
+            r.linear_damping = in.read<float>();
+            r.angular_damping = in.read<float>();
+            r.restitution = in.read<float>();
+            r.friction = in.read<float>();
+            r.physics_mode = in.read<uint8_t>();
+        }
+    }
+
+    void read_joints_from_pmx(ByteCursor& in, const PMXProperty& property, PMXModel& model) {
+        int number_of_joint = read_count_from_pmx(in);
+        model.joints.resize(number_of_joint);
+        for (auto& j : model.joints) {
+            j.name = read_string_to_arena(in, property.is_utf8, model.names);
+            j.name_en = read_string_to_arena(in, property.is_utf8, model.names);
+            j.type = in.read<uint8_t>();
+            j.rigid_body_a = read_index_from_pmx(in, property.rigid_body_index_size);
+            j.rigid_body_b = read_index_from_pmx(in, property.rigid_body_index_size);
+            j.position = in.read<float3>();
+            j.rotation = in.read<float3>();
+            j.linear_lower_limit = in.read<float3>();
+            j.linear_upper_limit = in.read<float3>();
+            j.angular_lower_limit = in.read<float3>();
+            j.angular_upper_limit = in.read<float3>();
+            j.linear_spring = in.read<float3>();
+            j.angular_spring = in.read<float3>();
+        }
+    }
+
+    void read_soft_bodies_from_pmx(ByteCursor& in, const PMXProperty& property, PMXModel& model) {
+        int number_of_soft_body = read_count_from_pmx(in);
+        model.soft_bodies.resize(number_of_soft_body);
+        for (auto& b : model.soft_bodies) {
+            b.name = read_string_to_arena(in, property.is_utf8, model.names);
+            b.name_en = read_string_to_arena(in, property.is_utf8, model.names);
+            b.shape = in.read<uint8_t>();
+            b.material = read_index_from_pmx(in, property.material_index_size);
+            b.group = in.read<uint8_t>();
+            b.non_collision_mask = in.read<uint16_t>();
+            b.flags = in.read<uint8_t>();
+            b.b_link_distance = in.read<int32_t>();
+            b.cluster_count = in.read<int32_t>();
+            b.total_mass = in.read<float>();
+            b.collision_margin = in.read<float>();
+            b.aero_model = in.read<int32_t>();
+            in.read_bytes(b.config, sizeof(b.config));
+            in.read_bytes(b.cluster, sizeof(b.cluster));
+            in.read_bytes(b.iteration, sizeof(b.iteration));
+            in.read_bytes(b.material_coef, sizeof(b.material_coef));
+            b.first_anchor = to_u32(model.soft_body_anchors.size());
+            b.anchor_count = read_count_from_pmx(in);
+            for (uint32_t k = 0; k < b.anchor_count; ++k) {
+                SoftBodyAnchor a;
+                a.rigid_body = read_index_from_pmx(in, property.rigid_body_index_size);
+                a.vertex = read_vertex_index_from_pmx(in, property.vertex_index_size);
+                a.near_mode = in.read<uint8_t>() != 0;
+                model.soft_body_anchors.push_back(a);
+            }
+            b.first_pin = to_u32(model.soft_body_pins.size());
+            b.pin_count = read_count_from_pmx(in);
+            for (uint32_t k = 0; k < b.pin_count; ++k) {
+                model.soft_body_pins.push_back(read_vertex_index_from_pmx(in, property.vertex_index_size));
+            }
+        }
+    }
+
     Vertex read_vertex_from_pmx(std::ifstream& in, int number_of_additional_uv, int bone_index_size) {
         Vertex v;
-        std::vector<float4> additional_uv(number_of_additional_uv);
         char weight_transformation;
 
         in.read(reinterpret_cast<char*>(&v),
                 sizeof(Vertex));
-        in.read(reinterpret_cast<char*>(additional_uv.data()),
-                number_of_additional_uv * sizeof(float4));
+        in.seekg(number_of_additional_uv * sizeof(float4), std::ios_base::cur);
         in.read(reinterpret_cast<char*>(&weight_transformation),
                 sizeof(char));
 
@@ -87,6 +1284,7 @@ namespace PMXLoader {
                 in.seekg(sizeof(float), std::ios_base::cur);
                 break;
             case 2://BDEF4
+            case 4://QDEF
                 in.seekg(bone_index_size, std::ios_base::cur);
                 in.seekg(bone_index_size, std::ios_base::cur);
                 in.seekg(bone_index_size, std::ios_base::cur);
@@ -118,19 +1316,41 @@ namespace PMXLoader {
         return v;
     }
 
-    std::string read_wstring_from_pmx(std::ifstream& in) {
-        std::array<char16_t, 1024> buffer{};
-        std::string output;
+    std::string read_wstring_from_pmx(std::ifstream& in, int is_utf8) {
         int size;
+        in.read(reinterpret_cast<char*>(&size), sizeof(int));
+        std::string buffer(std::max(size, 0), '\0');
+        in.read(buffer.data(), buffer.size());
+        if (is_utf8) {
+            return buffer;
+        }
 
-        std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> conv;
+        std::string output;
+        utf16le_to_utf8(reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size() / 2, output);
+        return output;
+    }
 
-        in.read(reinterpret_cast<char*>(&size), sizeof(int));
-        in.read(reinterpret_cast<char*>(&buffer), size);
+    PMXModel read_pmx_model(const std::string& filename) {
+        std::filesystem::path basedir = std::filesystem::path(filename).remove_filename();
+        MappedFile file(filename);
+        ByteCursor in(file.data(), file.size());
 
-        output = conv.to_bytes(buffer.data());
+        PMXModel model;
+        model.header = read_header_from_pmx(in);
+        const PMXProperty& property = model.header.property;
+        model.vertex = read_vertices_from_pmx(in, property);
+        model.planes = read_planes_from_pmx(in, property, model.vertex.vertices.size());
+        model.textures = read_textures_from_pmx(in, property, basedir);
+        model.materials = read_materials_from_pmx(in, property);
 
-        return output;
+        // some exporters stop after the last non-empty section; treat missing trailing sections as empty
+        if (in.remaining() > 0) read_bones_from_pmx(in, property, model);
+        if (in.remaining() > 0) read_morphs_from_pmx(in, property, model);
+        if (in.remaining() > 0) read_display_frames_from_pmx(in, property, model);
+        if (in.remaining() > 0) read_rigid_bodies_from_pmx(in, property, model);
+        if (in.remaining() > 0) read_joints_from_pmx(in, property, model);
+        if (model.header.version >= 2.1f && in.remaining() > 0) read_soft_bodies_from_pmx(in, property, model);
+        return model;
     }
 
     std::tuple<
@@ -138,6 +1358,20 @@ namespace PMXLoader {
         std::vector<int>,
         std::vector<std::filesystem::path>,
         std::vector<Material>> read_pmx(std::string filename) {
+        PMXModel model = read_pmx_model(filename);
+        std::vector<int> planes(model.planes.size());
+        for (size_t j = 0; j < planes.size(); ++j) {
+            planes[j] = static_cast<int>(model.planes[j]);
+        }
+        return {std::move(model.vertex.vertices), std::move(planes), std::move(model.textures), std::move(model.materials)};
+    }
+
+    // ifstream based reader, kept as the baseline for pmx_bench
+    std::tuple<
+        std::vector<Vertex>,
+        std::vector<int>,
+        std::vector<std::filesystem::path>,
+        std::vector<Material>> read_pmx_stream(std::string filename) {
         std::filesystem::path basedir = std::filesystem::path(filename).remove_filename();
         std::ifstream file(filename, std::ios::ate | std::ios::binary);
         if (!file.is_open()) {
@@ -174,10 +1408,10 @@ namespace PMXLoader {
             static_cast<int>(properties[6]),
             static_cast<int>(properties[7])
         };
-        model_name = read_wstring_from_pmx(file);
-        model_name_en = read_wstring_from_pmx(file);
-        comment = read_wstring_from_pmx(file);
-        comment_en = read_wstring_from_pmx(file);
+        model_name = read_wstring_from_pmx(file, property.is_utf8);
+        model_name_en = read_wstring_from_pmx(file, property.is_utf8);
+        comment = read_wstring_from_pmx(file, property.is_utf8);
+        comment_en = read_wstring_from_pmx(file, property.is_utf8);
 
         file.read(reinterpret_cast<char*>(&number_of_vertex), sizeof(int));
         std::vector<Vertex> vertices(number_of_vertex);
@@ -195,7 +1429,7 @@ namespace PMXLoader {
         file.read(reinterpret_cast<char*>(&number_of_texture), sizeof(int));
         std::vector<std::filesystem::path> textures(number_of_texture);
         for (int j = 0; j < number_of_texture; ++j) {
-            std::string p = read_wstring_from_pmx(file);
+            std::string p = read_wstring_from_pmx(file, property.is_utf8);
             std::replace(p.begin(), p.end(), '\\', '/');
             textures[j] = basedir / std::filesystem::path(p);
             //std::cout << textures[j] << std::filesystem::exists(textures[j]) << std::endl;
@@ -204,8 +1438,8 @@ namespace PMXLoader {
         file.read(reinterpret_cast<char*>(&number_of_material), sizeof(int));
         std::vector<Material> materials(number_of_material);
         for (int j = 0; j < number_of_material; ++j) {
-            materials[j].name = read_wstring_from_pmx(file);
-            materials[j].name_en = read_wstring_from_pmx(file);
+            materials[j].name = read_wstring_from_pmx(file, property.is_utf8);
+            materials[j].name_en = read_wstring_from_pmx(file, property.is_utf8);
             file.read(reinterpret_cast<char*>(&materials[j].diffuse), sizeof(float4));
             file.read(reinterpret_cast<char*>(&materials[j].specular), sizeof(float3));
             file.read(reinterpret_cast<char*>(&materials[j].specular_coef), sizeof(float));
@@ -240,7 +1474,7 @@ namespace PMXLoader {
                         break;
                 }
             }
-            materials[j].memo = read_wstring_from_pmx(file);
+            materials[j].memo = read_wstring_from_pmx(file, property.is_utf8);
             file.read(reinterpret_cast<char*>(&materials[j].number_of_plane), sizeof(int));
         }
 
@@ -273,4 +1507,6 @@ namespace PMXLoader {
         return {vertices, planes, textures, materials};
     }
 
-}
\ No newline at end of file
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef MODEL_INCLUDED
+#define MODEL_INCLUDED
+
+#include "mmd.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <filesystem>
+
+namespace Model {
+
+    // full precision vertex the mesh passes work on
+    struct Vertex {
+        glm::vec3 pos;
+        glm::vec3 color;
+        glm::vec2 texCoord;
+    };
+
+    // vertex layout uploaded to the GPU, split in two streams so the edge pass fetches only the first.
+    // pos: unorm16 within the mesh bounds (decoded with VertexQuantization); normal: octahedral snorm8x2
+    struct PackedPosition {
+        uint16_t pos[3];
+        int8_t normal[2];
+    };
+    static_assert(sizeof(PackedPosition) == 8, "PackedPosition must stay tightly packed");
+
+    // texCoord: half2. the texture comes per draw.
+    struct PackedAttributes {
+        uint16_t texCoord[2];
+    };
+    static_assert(sizeof(PackedAttributes) == 4, "PackedAttributes must stay tightly packed");
+
+    // pos = vec3(packed.pos) * scale + bias; vec4 so it can sit in a std140 uniform block
+    struct VertexQuantization {
+        glm::vec4 scale;
+        glm::vec4 bias;
+    };
+
+    // one PMX material; texture is pushed as a constant for the draw.
+    // its triangles are split into meshlets[firstMeshlet, firstMeshlet + meshletCount), one indirect command each
+    struct DrawRange {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        int32_t texture;  // -1: none
+        uint32_t material;
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+    };
+
+    // draws[firstDraw, firstDraw + drawCount) render the whole model at one level of detail, one draw per
+    // material. level 0 is the authored mesh; every level indexes the same vertex buffer.
+    struct LodLevel {
+        uint32_t firstDraw;
+        uint32_t drawCount;
+        float error;  // how far the simplified surface may be from the authored one, in model units
+        uint32_t padding;
+    };
+
+    // contiguous run of at most 64 vertices / 124 triangles of one DrawRange, culled by cull_meshlets.comp.
+    // std430 layout; bounds are in model space
+    struct Meshlet {
+        glm::vec4 sphere;  // xyz: center, w: radius
+        glm::vec4 cone;    // xyz: average facing, w: sin of the cone's half angle, >= 1 never culls
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t draw;
+        uint32_t commandBase;  // draws[draw].firstMeshlet: the draw's commands are compacted from here
+    };
+    static_assert(sizeof(Meshlet) == 48, "Meshlet must match the std430 struct in cull_meshlets.comp");
+
+    // upload-ready model data; indices are uint16 unless the model has more than 65536 vertices.
+    // positions/attributes are filled from vertices by MeshOptimizer::quantize_vertices once the passes are done.
+    struct Mesh {
+        std::vector<Vertex> vertices;
+        std::vector<PackedPosition> positions;
+        std::vector<PackedAttributes> attributes;
+        VertexQuantization quantization;
+        PMXLoader::FaceIndices indices;
+        std::vector<DrawRange> draws;
+        std::vector<LodLevel> lods;
+        std::vector<Meshlet> meshlets;
+        std::vector<std::filesystem::path> textures;
+    };
+
+    // non-owning view of upload-ready data, backed either by a Mesh or by a mapped cache file
+    struct MeshView {
+        const PackedPosition* positions = nullptr;
+        const PackedAttributes* attributes = nullptr;
+        size_t vertex_count = 0;
+        VertexQuantization quantization;
+        const void* indices = nullptr;  // uint16_t or uint32_t, see index_size
+        size_t index_count = 0;
+        uint32_t index_size = 2;
+        const DrawRange* draws = nullptr;
+        size_t draw_count = 0;
+        const LodLevel* lods = nullptr;
+        size_t lod_count = 0;
+        const Meshlet* meshlets = nullptr;
+        size_t meshlet_count = 0;
+    };
+
+    MeshView view_of(const Mesh& mesh) {
+        return {
+            mesh.positions.data(), mesh.attributes.data(), mesh.positions.size(), mesh.quantization,
+            mesh.indices.index_size == 2 ? static_cast<const void*>(mesh.indices.u16.data()) : mesh.indices.u32.data(),
+            mesh.indices.size(),
+            static_cast<uint32_t>(mesh.indices.index_size),
+            mesh.draws.data(), mesh.draws.size(),
+            mesh.lods.data(), mesh.lods.size(),
+            mesh.meshlets.data(), mesh.meshlets.size()
+        };
+    }
+
+    size_t index_bytes(const MeshView& view) {
+        return view.index_count * view.index_size;
+    }
+
+    // converts a parsed PMX into the layout the renderer consumes
+    Mesh build_mesh(const std::string& pmx_path) {
+        PMXLoader::PMXModel model = PMXLoader::read_pmx_model(pmx_path);
+        const auto& _vertices = model.vertex.vertices;
+        const auto& _materials = model.materials;
+        Mesh mesh;
+        mesh.textures = std::move(model.textures);
+
+        mesh.vertices.resize(_vertices.size());
+        for (size_t j = 0; j < _vertices.size(); ++j) {
+            auto _pos = _vertices[j].position;
+            auto _norm = _vertices[j].normal;
+            auto _uv = _vertices[j].uv;
+            mesh.vertices[j] = {
+                glm::vec3(_pos.x, _pos.y, _pos.z),
+                glm::vec3(_norm.x, _norm.y, _norm.z),
+                glm::vec2(_uv.x, _uv.y)
+            };
+        }
+
+        uint32_t firstIndex = 0;
+        for (size_t j = 0; j < _materials.size(); ++j) {
+            uint32_t indexCount = static_cast<uint32_t>(_materials[j].number_of_plane);
+            mesh.draws.push_back({firstIndex, indexCount, _materials[j].normal_texture, static_cast<uint32_t>(j), 0, 0});
+            firstIndex += indexCount;
+        }
+        mesh.lods.push_back({0, static_cast<uint32_t>(mesh.draws.size()), 0.0f, 0});
+
+        mesh.indices = std::move(model.planes);
+
+        return mesh;
+    }
+
+}
+
+#endif
@@ -0,0 +1,201 @@
+#include "mmd.hpp"
+#include "model.hpp"
+#include "mesh.hpp"
+#include "codec.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <codecvt>
+#include <locale>
+
+// usage: pmx_bench <model.pmx> [iterations]
+//
+// compares the mmap based PMXLoader::read_pmx with the ifstream based reader,
+// times Model::build_mesh (the conversion VulkanApp::loadModel runs on a cache miss),
+// then times the string-heavy texture and material sections on their own and
+// compares the MeshCodec encoded .pmxc vertex and index blobs against the raw ones.
+// needs no GPU; pmx_gen writes synthetic input.
+
+template <typename F>
+double measure_ms(int iterations, F&& f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int j = 0; j < iterations; ++j) {
+        f();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+bool same_result(const decltype(PMXLoader::read_pmx(""))& a, const decltype(PMXLoader::read_pmx(""))& b) {
+    const auto& [va, pa, ta, ma] = a;
+    const auto& [vb, pb, tb, mb] = b;
+    if (va.size() != vb.size() || pa != pb || ta != tb || ma.size() != mb.size()) {
+        return false;
+    }
+    if (std::memcmp(va.data(), vb.data(), va.size() * sizeof(PMXLoader::Vertex)) != 0) {
+        return false;
+    }
+    for (size_t j = 0; j < ma.size(); ++j) {
+        if (ma[j].name != mb[j].name || ma[j].number_of_plane != mb[j].number_of_plane) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void bench_string_sections(const std::string& path, int iterations) {
+    PMXLoader::MappedFile file(path);
+    PMXLoader::ByteCursor in(file.data(), file.size());
+    auto header = PMXLoader::read_header_from_pmx(in);
+    const auto& property = header.property;
+    auto vertex = PMXLoader::read_vertices_from_pmx(in, property);
+    PMXLoader::read_planes_from_pmx(in, property, vertex.vertices.size());
+
+    size_t begin = in.offset();
+    auto textures = PMXLoader::read_textures_from_pmx(in, property, "");
+    auto materials = PMXLoader::read_materials_from_pmx(in, property);
+    double kilobytes = (in.offset() - begin) / 1024.0;
+
+    double section_ms = measure_ms(iterations, [&] {
+        PMXLoader::ByteCursor section(file.data(), file.size());
+        section.seek(begin);
+        PMXLoader::read_textures_from_pmx(section, property, "");
+        PMXLoader::read_materials_from_pmx(section, property);
+    });
+    std::cout << "texture+material sections (" << (property.is_utf8 ? "UTF-8" : "UTF-16") << "): "
+              << textures.size() << " textures, " << materials.size() << " materials, " << kilobytes << " KB, "
+              << section_ms << " ms (" << kilobytes / 1024.0 / (section_ms / 1000.0) << " MB/s)" << std::endl;
+
+    if (property.is_utf8) {
+        return;
+    }
+
+    // transcoder alone against std::wstring_convert on the same UTF-16 strings
+    std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> conv;
+    std::vector<std::u16string> strings;
+    for (const auto& t : textures) {
+        strings.push_back(conv.from_bytes(t.string()));
+    }
+    for (const auto& m : materials) {
+        strings.push_back(conv.from_bytes(m.name));
+        strings.push_back(conv.from_bytes(m.name_en));
+        strings.push_back(conv.from_bytes(m.memo));
+    }
+    size_t units = 0;
+    for (const auto& str : strings) {
+        units += str.size();
+    }
+    double megabytes = units * sizeof(char16_t) / (1024.0 * 1024.0);
+
+    double simd_ms = measure_ms(iterations, [&] {
+        for (const auto& str : strings) {
+            std::string out;
+            PMXLoader::utf16le_to_utf8(reinterpret_cast<const uint8_t*>(str.data()), str.size(), out);
+        }
+    });
+    double codecvt_ms = measure_ms(iterations, [&] {
+        for (const auto& str : strings) {
+            std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> c;
+            c.to_bytes(str);
+        }
+    });
+    std::cout << "utf16le_to_utf8: " << strings.size() << " strings, " << simd_ms << " ms (" << megabytes / (simd_ms / 1000.0) << " MB/s)" << std::endl;
+    std::cout << "wstring_convert: " << strings.size() << " strings, " << codecvt_ms << " ms (" << megabytes / (codecvt_ms / 1000.0) << " MB/s)" << std::endl;
+}
+
+// the optimized blobs PMXCache writes, minus the overdraw and lod passes that do not change the statistics much
+void bench_codec(const std::string& path, int iterations) {
+    Model::Mesh mesh = Model::build_mesh(path);
+    MeshOptimizer::deduplicate_vertices(mesh);
+    MeshOptimizer::optimize_vertex_cache(mesh);
+    MeshOptimizer::optimize_vertex_fetch(mesh);
+    MeshOptimizer::quantize_vertices(mesh);
+
+    auto report = [&](const char* label, size_t raw, const std::vector<uint8_t>& encoded, double decode_ms, double copy_ms) {
+        double megabytes = raw / (1024.0 * 1024.0);
+        std::cout << label << raw / 1024.0 << " KB -> " << encoded.size() / 1024.0 << " KB ("
+                  << 100.0 * encoded.size() / std::max<size_t>(raw, 1) << "%), decode " << decode_ms << " ms ("
+                  << megabytes / (decode_ms / 1000.0) << " MB/s), memcpy " << megabytes / (copy_ms / 1000.0) << " MB/s" << std::endl;
+    };
+    auto bench_vertices = [&](const char* label, const void* data, size_t stride) {
+        size_t raw = mesh.positions.size() * stride;
+        std::vector<uint8_t> encoded = MeshCodec::encode_vertices(data, mesh.positions.size(), stride);
+        std::vector<uint8_t> decoded(raw);
+        MeshCodec::decode_vertices(decoded.data(), stride, encoded.data(), encoded.size());
+        if (std::memcmp(decoded.data(), data, raw) != 0) {
+            throw std::runtime_error(std::string("vertex codec mismatch: ") + label);
+        }
+        double decode_ms = measure_ms(iterations, [&] { MeshCodec::decode_vertices(decoded.data(), stride, encoded.data(), encoded.size()); });
+        double copy_ms = measure_ms(iterations, [&] { std::memcpy(decoded.data(), data, raw); });
+        report(label, raw, encoded, decode_ms, copy_ms);
+    };
+    auto bench_indices = [&](const auto& indices) {
+        using Index = typename std::decay_t<decltype(indices)>::value_type;
+        size_t raw = indices.size() * sizeof(Index);
+        std::vector<uint8_t> encoded = MeshCodec::encode_indices(indices.data(), indices.size());
+        std::vector<Index> decoded(indices.size());
+        MeshCodec::decode_indices(decoded.data(), encoded.data(), encoded.size(), mesh.positions.size());
+        if (decoded != indices) {
+            throw std::runtime_error("index codec mismatch");
+        }
+        double decode_ms = measure_ms(iterations, [&] { MeshCodec::decode_indices(decoded.data(), encoded.data(), encoded.size(), mesh.positions.size()); });
+        double copy_ms = measure_ms(iterations, [&] { std::memcpy(decoded.data(), indices.data(), raw); });
+        report("indices:    ", raw, encoded, decode_ms, copy_ms);
+    };
+
+    bench_vertices("positions:  ", mesh.positions.data(), sizeof(Model::PackedPosition));
+    bench_vertices("attributes: ", mesh.attributes.data(), sizeof(Model::PackedAttributes));
+    if (mesh.indices.index_size == 2) {
+        bench_indices(mesh.indices.u16);
+    } else {
+        bench_indices(mesh.indices.u32);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <model.pmx> [iterations]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::string path = argv[1];
+    int iterations = argc > 2 ? std::max(1, std::atoi(argv[2])) : 10;
+
+    try {
+        double megabytes = std::filesystem::file_size(path) / (1024.0 * 1024.0);
+
+        auto reference = PMXLoader::read_pmx_stream(path);
+        auto mapped = PMXLoader::read_pmx(path);
+        if (!same_result(reference, mapped)) {
+            std::cerr << "mismatch between read_pmx and read_pmx_stream" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        double stream_ms = measure_ms(iterations, [&] { PMXLoader::read_pmx_stream(path); });
+        double mapped_ms = measure_ms(iterations, [&] { PMXLoader::read_pmx(path); });
+        double mesh_ms = measure_ms(iterations, [&] { Model::build_mesh(path); });
+
+        double vertices = static_cast<double>(std::get<0>(mapped).size());
+        auto report = [&](const char* label, double ms) {
+            std::cout << label << ms << " ms (" << megabytes / (ms / 1000.0) << " MB/s, "
+                      << vertices / (ms / 1000.0) / 1e6 << " M vertices/s)" << std::endl;
+        };
+        std::cout << path << ": " << std::get<0>(mapped).size() << " vertices, "
+                  << std::get<1>(mapped).size() / 3 << " faces, "
+                  << megabytes << " MB, " << iterations << " iterations" << std::endl;
+        report("ifstream:   ", stream_ms);
+        report("mmap:       ", mapped_ms);
+        report("build_mesh: ", mesh_ms);
+        std::cout << "speedup:    " << stream_ms / mapped_ms << "x" << std::endl;
+
+        bench_string_sections(path, iterations);
+        bench_codec(path, iterations);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,321 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+
+// usage: pmx_gen <out.pmx> [options]
+//
+// writes a synthetic PMX 2.0 model for loader benchmarks.
+//   --vertices N          vertex count (default 100000)
+//   --triangles N         triangle count (default 2 * vertices)
+//   --deform a,b,c,d,e    relative weights of BDEF1,BDEF2,BDEF4,SDEF,QDEF (default 40,40,15,5,0)
+//   --index-size 1|2|4    vertex index width (default: smallest that fits)
+//   --additional-uv N     additional uv count, 0..4 (default 0)
+//   --textures N          (default 8)
+//   --materials N         (default 16)
+//   --bones N             (default 128)
+//   --utf8                UTF-8 strings instead of UTF-16
+//   --seed N              (default 1)
+
+struct Options {
+    std::string path;
+    int vertices = 100000;
+    int triangles = -1;
+    double deform[5] = {40, 40, 15, 5, 0};
+    int index_size = 0;
+    int additional_uv = 0;
+    int textures = 8;
+    int materials = 16;
+    int bones = 128;
+    bool utf8 = false;
+    unsigned seed = 1;
+};
+
+class Writer {
+public:
+    explicit Writer(bool utf8) : utf8(utf8) {}
+
+    template <typename T>
+    void put(T v) {
+        bytes.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    // index of the given byte width; -1 is encoded as all ones
+    void put_index(int v, int size) {
+        switch (size) {
+            case 1: put(static_cast<int8_t>(v)); break;
+            case 2: put(static_cast<int16_t>(v)); break;
+            default: put(static_cast<int32_t>(v)); break;
+        }
+    }
+
+    // vertex indices are unsigned at 1 and 2 bytes
+    void put_vertex_index(uint32_t v, int size) {
+        switch (size) {
+            case 1: put(static_cast<uint8_t>(v)); break;
+            case 2: put(static_cast<uint16_t>(v)); break;
+            default: put(static_cast<int32_t>(v)); break;
+        }
+    }
+
+    // s is utf-8
+    void put_string(const std::string& s) {
+        if (utf8) {
+            put(static_cast<int32_t>(s.size()));
+            bytes.append(s);
+            return;
+        }
+        std::u16string u;
+        for (size_t j = 0; j < s.size();) {
+            uint32_t c = static_cast<uint8_t>(s[j]);
+            int n = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+            c &= n == 1 ? 0x7F : (0x7F >> n);
+            for (int k = 1; k < n; ++k) {
+                c = (c << 6) | (static_cast<uint8_t>(s[j + k]) & 0x3F);
+            }
+            j += n;
+            if (c >= 0x10000) {
+                c -= 0x10000;
+                u.push_back(static_cast<char16_t>(0xD800 + (c >> 10)));
+                u.push_back(static_cast<char16_t>(0xDC00 + (c & 0x3FF)));
+            } else {
+                u.push_back(static_cast<char16_t>(c));
+            }
+        }
+        put(static_cast<int32_t>(u.size() * 2));
+        for (char16_t c : u) {
+            put(static_cast<uint16_t>(c));
+        }
+    }
+
+    std::string bytes;
+
+private:
+    bool utf8;
+};
+
+int index_size_for(int count) {
+    return count < 0x80 ? 1 : count < 0x8000 ? 2 : 4;
+}
+
+int vertex_index_size_for(int count) {
+    return count <= 0xFF ? 1 : count <= 0xFFFF ? 2 : 4;
+}
+
+std::string generate(const Options& opt) {
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> bone(0, std::max(opt.bones - 1, 0));
+    std::discrete_distribution<int> deform(std::begin(opt.deform), std::end(opt.deform));
+
+    int vertex_index_size = opt.index_size ? opt.index_size : vertex_index_size_for(opt.vertices);
+    int texture_index_size = index_size_for(opt.textures);
+    int material_index_size = index_size_for(opt.materials);
+    int bone_index_size = index_size_for(opt.bones);
+    int triangles = opt.triangles < 0 ? 2 * opt.vertices : opt.triangles;
+
+    Writer w(opt.utf8);
+    w.bytes.append("PMX ", 4);
+    w.put(2.0f);
+    w.put(static_cast<uint8_t>(8));
+    for (int v : {opt.utf8 ? 1 : 0, opt.additional_uv, vertex_index_size, texture_index_size, material_index_size, bone_index_size, 1, 1}) {
+        w.put(static_cast<uint8_t>(v));
+    }
+    w.put_string("合成モデル");
+    w.put_string("synthetic model");
+    w.put_string("pmx_gen で生成したベンチマーク用モデル");
+    w.put_string("generated by pmx_gen");
+
+    w.put(static_cast<int32_t>(opt.vertices));
+    for (int j = 0; j < opt.vertices; ++j) {
+        for (int k = 0; k < 8 + 4 * opt.additional_uv; ++k) {
+            w.put(unit(rng));
+        }
+        int type = deform(rng);
+        w.put(static_cast<uint8_t>(type));
+        switch (type) {
+            case 0:
+                w.put_index(bone(rng), bone_index_size);
+                break;
+            case 1:
+                w.put_index(bone(rng), bone_index_size);
+                w.put_index(bone(rng), bone_index_size);
+                w.put(0.5f * (unit(rng) + 1.0f));
+                break;
+            case 2:
+            case 4:
+                for (int k = 0; k < 4; ++k) {
+                    w.put_index(bone(rng), bone_index_size);
+                }
+                for (float weight : {0.4f, 0.3f, 0.2f, 0.1f}) {
+                    w.put(weight);
+                }
+                break;
+            case 3:
+                w.put_index(bone(rng), bone_index_size);
+                w.put_index(bone(rng), bone_index_size);
+                w.put(0.5f * (unit(rng) + 1.0f));
+                for (int k = 0; k < 9; ++k) {
+                    w.put(unit(rng));
+                }
+                break;
+        }
+        w.put(1.0f);
+    }
+
+    // triangles sweep through the vertex array so consecutive faces share vertices, like a real mesh
+    w.put(static_cast<int32_t>(3 * triangles));
+    uint32_t n = static_cast<uint32_t>(std::max(opt.vertices, 1));
+    for (int j = 0; j < triangles; ++j) {
+        uint32_t base = static_cast<uint32_t>(j / 2) % n;
+        w.put_vertex_index(base, vertex_index_size);
+        w.put_vertex_index((base + 1 + j % 2) % n, vertex_index_size);
+        w.put_vertex_index((base + 2 - j % 2) % n, vertex_index_size);
+    }
+
+    w.put(static_cast<int32_t>(opt.textures));
+    for (int j = 0; j < opt.textures; ++j) {
+        w.put_string("tex\\テクスチャ" + std::to_string(j) + ".png");
+    }
+
+    w.put(static_cast<int32_t>(opt.materials));
+    for (int j = 0; j < opt.materials; ++j) {
+        int first = static_cast<int>(static_cast<int64_t>(triangles) * j / opt.materials);
+        int last = static_cast<int>(static_cast<int64_t>(triangles) * (j + 1) / opt.materials);
+        w.put_string("材質" + std::to_string(j));
+        w.put_string("material" + std::to_string(j));
+        for (float v : {1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 5.0f, 0.5f, 0.5f, 0.5f}) {
+            w.put(v);
+        }
+        w.put(static_cast<uint8_t>(0x10));
+        for (float v : {0.0f, 0.0f, 0.0f, 1.0f, 1.0f}) {
+            w.put(v);
+        }
+        w.put_index(opt.textures ? j % opt.textures : -1, texture_index_size);
+        w.put_index(-1, texture_index_size);
+        w.put(static_cast<uint8_t>(0));
+        w.put(static_cast<uint8_t>(1));
+        w.put(static_cast<uint8_t>(j % 10));
+        w.put_string("");
+        w.put(static_cast<int32_t>(3 * (last - first)));
+    }
+
+    // a simple chain of bones; the remaining sections are empty
+    w.put(static_cast<int32_t>(opt.bones));
+    for (int j = 0; j < opt.bones; ++j) {
+        w.put_string("ボーン" + std::to_string(j));
+        w.put_string("bone" + std::to_string(j));
+        for (float v : {0.0f, static_cast<float>(j), 0.0f}) {
+            w.put(v);
+        }
+        w.put_index(j - 1, bone_index_size);
+        w.put(static_cast<int32_t>(0));
+        w.put(static_cast<uint16_t>(0x001F));
+        w.put_index(j + 1 < opt.bones ? j + 1 : -1, bone_index_size);
+    }
+    for (int section = 0; section < 5; ++section) {
+        w.put(static_cast<int32_t>(0));
+    }
+
+    return std::move(w.bytes);
+}
+
+int parse_int(const char* s) {
+    char* end;
+    long v = std::strtol(s, &end, 10);
+    if (*end != '\0' || v < 0) {
+        throw std::runtime_error(std::string("invalid number: ") + s);
+    }
+    return static_cast<int>(v);
+}
+
+Options parse_options(int argc, char** argv) {
+    Options opt;
+    opt.path = argv[1];
+    for (int j = 2; j < argc; ++j) {
+        std::string arg = argv[j];
+        auto value = [&]() -> const char* {
+            if (j + 1 >= argc) {
+                throw std::runtime_error("missing value for " + arg);
+            }
+            return argv[++j];
+        };
+        if (arg == "--vertices") {
+            opt.vertices = parse_int(value());
+        } else if (arg == "--triangles") {
+            opt.triangles = parse_int(value());
+        } else if (arg == "--deform") {
+            std::stringstream ss(value());
+            std::string item;
+            for (int k = 0; k < 5; ++k) {
+                opt.deform[k] = std::getline(ss, item, ',') ? std::atof(item.c_str()) : 0.0;
+            }
+        } else if (arg == "--index-size") {
+            opt.index_size = parse_int(value());
+        } else if (arg == "--additional-uv") {
+            opt.additional_uv = parse_int(value());
+        } else if (arg == "--textures") {
+            opt.textures = parse_int(value());
+        } else if (arg == "--materials") {
+            opt.materials = parse_int(value());
+        } else if (arg == "--bones") {
+            opt.bones = parse_int(value());
+        } else if (arg == "--utf8") {
+            opt.utf8 = true;
+        } else if (arg == "--seed") {
+            opt.seed = static_cast<unsigned>(parse_int(value()));
+        } else {
+            throw std::runtime_error("unknown option: " + arg);
+        }
+    }
+
+    if (opt.index_size != 0 && opt.index_size != 1 && opt.index_size != 2 && opt.index_size != 4) {
+        throw std::runtime_error("--index-size must be 1, 2 or 4");
+    }
+    if (opt.index_size != 0 && opt.index_size < vertex_index_size_for(opt.vertices)) {
+        throw std::runtime_error(std::to_string(opt.vertices) + " vertices do not fit in " + std::to_string(opt.index_size) + " byte indices");
+    }
+    if (opt.additional_uv > 4) {
+        throw std::runtime_error("--additional-uv must be 0..4");
+    }
+    if (opt.materials < 1) {
+        throw std::runtime_error("--materials must be at least 1");
+    }
+    if (opt.bones < 1) {
+        throw std::runtime_error("--bones must be at least 1");
+    }
+    return opt;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <out.pmx> [--vertices N] [--triangles N] [--deform a,b,c,d,e] [--index-size 1|2|4]"
+                  << " [--additional-uv N] [--textures N] [--materials N] [--bones N] [--utf8] [--seed N]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        Options opt = parse_options(argc, argv);
+        std::string bytes = generate(opt);
+        std::ofstream out(opt.path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw std::runtime_error("failed to open file: " + opt.path);
+        }
+        out.write(bytes.data(), bytes.size());
+        if (!out) {
+            throw std::runtime_error("failed to write file: " + opt.path);
+        }
+        std::cout << opt.path << ": " << opt.vertices << " vertices, " << bytes.size() / (1024.0 * 1024.0) << " MB" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,375 @@
+#ifndef PMXC_INCLUDED
+#define PMXC_INCLUDED
+
+#include "mmd.hpp"
+#include "model.hpp"
+#include "mesh.hpp"
+#include "codec.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+// .pmxc: upload-ready Model::Mesh blobs cached next to the source .pmx
+//
+// layout: Header, Chunk[chunk_count], then each chunk's bytes at a 16 byte aligned offset.
+// the cache is valid only when version, source hash/size and vertex stride all match.
+// vertex and index blobs are stored MeshCodec-encoded and decoded into MeshSource::mesh on open.
+namespace PMXCache {
+
+    // bump whenever Model::build_mesh, MeshOptimizer or the blob layout changes
+    const uint32_t VERSION = 12;
+
+    // 1, 2 and 6 held raw positions, indices and attributes before version 12; they are not read
+    enum ChunkId : uint32_t {
+        CHUNK_DRAWS = 3,
+        CHUNK_TEXTURES = 4,  // (uint32 length, utf-8 bytes)*, relative to the .pmx directory
+        CHUNK_QUANTIZATION = 5,  // Model::VertexQuantization of CHUNK_POSITIONS_CODED
+        CHUNK_MESHLETS = 7,
+        CHUNK_LODS = 8,
+        CHUNK_POSITIONS_CODED = 9,   // MeshCodec::encode_vertices of Model::PackedPosition
+        CHUNK_ATTRIBUTES_CODED = 10, // MeshCodec::encode_vertices of Model::PackedAttributes
+        CHUNK_INDICES_CODED = 11,    // MeshCodec::encode_indices, element_size is the index size
+    };
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t source_hash;
+        uint64_t source_size;
+        uint32_t vertex_stride;
+        uint32_t chunk_count;
+    };
+
+    struct Chunk {
+        uint32_t id;
+        uint32_t element_size;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // 64-bit hash over the whole file; four independent lanes keep the multiplies pipelined
+    uint64_t hash_bytes(const uint8_t* data, size_t size) {
+        const uint64_t k0 = 0x9E3779B97F4A7C15ull;
+        const uint64_t k1 = 0xC2B2AE3D27D4EB4Full;
+        auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+        auto round = [&](uint64_t acc, uint64_t word) { return rotl(acc + word * k1, 31) * k0; };
+
+        uint64_t lanes[4] = {k0, k1, ~k0, ~k1};
+        size_t j = 0;
+        for (; j + 32 <= size; j += 32) {
+            for (int l = 0; l < 4; ++l) {
+                uint64_t word;
+                std::memcpy(&word, data + j + 8 * l, sizeof(word));
+                lanes[l] = round(lanes[l], word);
+            }
+        }
+        uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+        for (; j < size; ++j) {
+            h = round(h, data[j]);
+        }
+        h ^= size;
+        h ^= h >> 33;
+        h *= k1;
+        h ^= h >> 29;
+        return h;
+    }
+
+    std::string cache_path_of(const std::string& pmx_path) {
+        return pmx_path + "c";
+    }
+
+    void write(const std::string& cache_path, uint64_t source_hash, uint64_t source_size, const std::filesystem::path& basedir, const Model::Mesh& mesh) {
+        std::string textures;
+        for (const auto& t : mesh.textures) {
+            std::string p = t.lexically_relative(basedir).generic_string();
+            uint32_t length = static_cast<uint32_t>(p.size());
+            textures.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            textures.append(p);
+        }
+
+        Model::MeshView view = Model::view_of(mesh);
+        std::vector<uint8_t> positions = MeshCodec::encode_vertices(view.positions, view.vertex_count, sizeof(Model::PackedPosition));
+        std::vector<uint8_t> attributes = MeshCodec::encode_vertices(view.attributes, view.vertex_count, sizeof(Model::PackedAttributes));
+        std::vector<uint8_t> indices = view.index_size == 2
+            ? MeshCodec::encode_indices(mesh.indices.u16.data(), mesh.indices.u16.size())
+            : MeshCodec::encode_indices(mesh.indices.u32.data(), mesh.indices.u32.size());
+
+        struct Blob { uint32_t id; uint32_t element_size; const void* data; size_t size; };
+        std::vector<Blob> blobs = {
+            {CHUNK_POSITIONS_CODED, sizeof(Model::PackedPosition), positions.data(), positions.size()},
+            {CHUNK_ATTRIBUTES_CODED, sizeof(Model::PackedAttributes), attributes.data(), attributes.size()},
+            {CHUNK_INDICES_CODED, view.index_size, indices.data(), indices.size()},
+            {CHUNK_DRAWS, sizeof(Model::DrawRange), view.draws, view.draw_count * sizeof(Model::DrawRange)},
+            {CHUNK_LODS, sizeof(Model::LodLevel), view.lods, view.lod_count * sizeof(Model::LodLevel)},
+            {CHUNK_MESHLETS, sizeof(Model::Meshlet), view.meshlets, view.meshlet_count * sizeof(Model::Meshlet)},
+            {CHUNK_TEXTURES, 1, textures.data(), textures.size()},
+            {CHUNK_QUANTIZATION, sizeof(Model::VertexQuantization), &view.quantization, sizeof(Model::VertexQuantization)},
+        };
+
+        Header header{{'P', 'M', 'X', 'C'}, VERSION, source_hash, source_size, sizeof(Model::PackedPosition), static_cast<uint32_t>(blobs.size())};
+        std::vector<Chunk> chunks;
+        uint64_t offset = sizeof(Header) + blobs.size() * sizeof(Chunk);
+        for (const auto& b : blobs) {
+            offset = (offset + 15) & ~uint64_t(15);
+            chunks.push_back({b.id, b.element_size, offset, b.size});
+            offset += b.size;
+        }
+
+        // write to a temporary file and rename, so a crash never leaves a half-written cache
+        std::string tmp_path = cache_path + ".tmp";
+        {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                throw std::runtime_error("failed to open file: " + tmp_path);
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(chunks.data()), chunks.size() * sizeof(Chunk));
+            for (size_t j = 0; j < blobs.size(); ++j) {
+                static const char padding[16] = {};
+                out.write(padding, chunks[j].offset - static_cast<uint64_t>(out.tellp()));
+                out.write(static_cast<const char*>(blobs[j].data), blobs[j].size);
+            }
+            if (!out) {
+                throw std::runtime_error("failed to write file: " + tmp_path);
+            }
+        }
+        std::filesystem::rename(tmp_path, cache_path);
+    }
+
+    // upload-ready model: either built from the .pmx or mapped from a valid .pmxc.
+    // view points into mesh or mapping, both of which keep their storage when moved;
+    // a cache's coded vertex and index chunks are decoded into mesh.
+    struct MeshSource {
+        Model::MeshView view;
+        std::vector<std::filesystem::path> textures;
+        bool from_cache = false;
+
+        std::optional<PMXLoader::MappedFile> mapping;
+        Model::Mesh mesh;
+
+        explicit MeshSource(Model::Mesh&& built) : mesh(std::move(built)) {
+            view = Model::view_of(mesh);
+            textures = mesh.textures;
+        }
+
+        explicit MeshSource(PMXLoader::MappedFile&& file) : from_cache(true), mapping(std::move(file)) {}
+    };
+
+    // maps cache_path and validates it against the source; returns nullopt on any mismatch
+    std::optional<MeshSource> open(const std::string& cache_path, uint64_t source_hash, uint64_t source_size, const std::filesystem::path& basedir) {
+        if (!std::filesystem::exists(cache_path)) {
+            return std::nullopt;
+        }
+
+        std::optional<MeshSource> mapped;
+        try {
+            mapped.emplace(PMXLoader::MappedFile(cache_path));
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return std::nullopt;
+        }
+        MeshSource& source = *mapped;
+        const uint8_t* base = source.mapping->data();
+        size_t size = source.mapping->size();
+
+        Header header;
+        if (size < sizeof(Header)) {
+            return std::nullopt;
+        }
+        std::memcpy(&header, base, sizeof(Header));
+        if (std::memcmp(header.magic, "PMXC", 4) != 0
+            || header.version != VERSION
+            || header.source_hash != source_hash
+            || header.source_size != source_size
+            || header.vertex_stride != sizeof(Model::PackedPosition)
+            || size < sizeof(Header) + header.chunk_count * sizeof(Chunk)) {
+            return std::nullopt;
+        }
+
+        const uint8_t* textures = nullptr;
+        size_t textures_size = 0;
+        bool has_quantization = false;
+        size_t attribute_count = 0;
+        Chunk coded_positions{}, coded_attributes{}, coded_indices{};
+        for (uint32_t j = 0; j < header.chunk_count; ++j) {
+            Chunk chunk;
+            std::memcpy(&chunk, base + sizeof(Header) + j * sizeof(Chunk), sizeof(Chunk));
+            if (chunk.offset > size || chunk.size > size - chunk.offset || chunk.offset % 16 != 0) {
+                std::cerr << cache_path << ": corrupted chunk " << chunk.id << std::endl;
+                return std::nullopt;
+            }
+            const uint8_t* p = base + chunk.offset;
+            switch (chunk.id) {
+                case CHUNK_DRAWS:
+                    source.view.draws = reinterpret_cast<const Model::DrawRange*>(p);
+                    source.view.draw_count = chunk.size / sizeof(Model::DrawRange);
+                    break;
+                case CHUNK_LODS:
+                    source.view.lods = reinterpret_cast<const Model::LodLevel*>(p);
+                    source.view.lod_count = chunk.size / sizeof(Model::LodLevel);
+                    break;
+                case CHUNK_MESHLETS:
+                    source.view.meshlets = reinterpret_cast<const Model::Meshlet*>(p);
+                    source.view.meshlet_count = chunk.size / sizeof(Model::Meshlet);
+                    break;
+                case CHUNK_TEXTURES:
+                    textures = p;
+                    textures_size = chunk.size;
+                    break;
+                case CHUNK_POSITIONS_CODED:
+                    coded_positions = chunk;
+                    break;
+                case CHUNK_ATTRIBUTES_CODED:
+                    coded_attributes = chunk;
+                    break;
+                case CHUNK_INDICES_CODED:
+                    coded_indices = chunk;
+                    break;
+                case CHUNK_QUANTIZATION:
+                    if (chunk.size != sizeof(Model::VertexQuantization)) {
+                        std::cerr << cache_path << ": corrupted chunk " << chunk.id << std::endl;
+                        return std::nullopt;
+                    }
+                    std::memcpy(&source.view.quantization, p, sizeof(Model::VertexQuantization));
+                    has_quantization = true;
+                    break;
+            }
+        }
+
+        try {
+            Model::Mesh& mesh = source.mesh;
+            if (coded_positions.id != 0) {
+                const uint8_t* p = base + coded_positions.offset;
+                mesh.positions.resize(MeshCodec::decoded_vertex_count(p, coded_positions.size, sizeof(Model::PackedPosition)));
+                MeshCodec::decode_vertices(mesh.positions.data(), sizeof(Model::PackedPosition), p, coded_positions.size);
+                source.view.positions = mesh.positions.data();
+                source.view.vertex_count = mesh.positions.size();
+            }
+            if (coded_attributes.id != 0) {
+                const uint8_t* p = base + coded_attributes.offset;
+                mesh.attributes.resize(MeshCodec::decoded_vertex_count(p, coded_attributes.size, sizeof(Model::PackedAttributes)));
+                MeshCodec::decode_vertices(mesh.attributes.data(), sizeof(Model::PackedAttributes), p, coded_attributes.size);
+                source.view.attributes = mesh.attributes.data();
+                attribute_count = mesh.attributes.size();
+            }
+            if (coded_indices.id != 0) {
+                const uint8_t* p = base + coded_indices.offset;
+                size_t count = MeshCodec::decoded_index_count(p, coded_indices.size);
+                mesh.indices.index_size = static_cast<int>(coded_indices.element_size);
+                if (coded_indices.element_size == 2) {
+                    mesh.indices.u16.resize(count);
+                    MeshCodec::decode_indices(mesh.indices.u16.data(), p, coded_indices.size, std::min<size_t>(source.view.vertex_count, 0x10000));
+                    source.view.indices = mesh.indices.u16.data();
+                } else if (coded_indices.element_size == 4) {
+                    mesh.indices.u32.resize(count);
+                    MeshCodec::decode_indices(mesh.indices.u32.data(), p, coded_indices.size, source.view.vertex_count);
+                    source.view.indices = mesh.indices.u32.data();
+                } else {
+                    std::cerr << cache_path << ": invalid index size " << coded_indices.element_size << std::endl;
+                    return std::nullopt;
+                }
+                source.view.index_size = coded_indices.element_size;
+                source.view.index_count = count;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << cache_path << ": " << e.what() << std::endl;
+            return std::nullopt;
+        }
+
+        if (!has_quantization || coded_positions.id == 0 || coded_indices.id == 0 || attribute_count != source.view.vertex_count) {
+            return std::nullopt;
+        }
+        for (size_t j = 0; j < source.view.draw_count; ++j) {
+            const Model::DrawRange& draw = source.view.draws[j];
+            if (draw.firstMeshlet > source.view.meshlet_count || draw.meshletCount > source.view.meshlet_count - draw.firstMeshlet) {
+                std::cerr << cache_path << ": corrupted meshlet ranges" << std::endl;
+                return std::nullopt;
+            }
+            if (static_cast<uint64_t>(draw.firstIndex) + draw.indexCount > source.view.index_count) {
+                std::cerr << cache_path << ": corrupted draw ranges" << std::endl;
+                return std::nullopt;
+            }
+        }
+        // the culling shader takes draw and commandBase as write targets: a meshlet must lie inside the
+        // draw it names, and compact into that draw's slots
+        for (size_t j = 0; j < source.view.meshlet_count; ++j) {
+            const Model::Meshlet& meshlet = source.view.meshlets[j];
+            if (meshlet.draw >= source.view.draw_count
+                || static_cast<uint64_t>(meshlet.firstIndex) + meshlet.indexCount > source.view.index_count) {
+                std::cerr << cache_path << ": corrupted meshlets" << std::endl;
+                return std::nullopt;
+            }
+            const Model::DrawRange& draw = source.view.draws[meshlet.draw];
+            if (meshlet.commandBase != draw.firstMeshlet || j < draw.firstMeshlet || j - draw.firstMeshlet >= draw.meshletCount) {
+                std::cerr << cache_path << ": corrupted meshlets" << std::endl;
+                return std::nullopt;
+            }
+        }
+        if (source.view.lod_count == 0) {
+            return std::nullopt;
+        }
+        for (size_t j = 0; j < source.view.lod_count; ++j) {
+            const Model::LodLevel& lod = source.view.lods[j];
+            if (lod.drawCount == 0 || lod.firstDraw > source.view.draw_count || lod.drawCount > source.view.draw_count - lod.firstDraw) {
+                std::cerr << cache_path << ": corrupted lod ranges" << std::endl;
+                return std::nullopt;
+            }
+        }
+
+        try {
+            PMXLoader::ByteCursor in(textures, textures_size);
+            while (in.remaining() > 0) {
+                uint32_t length = in.read<uint32_t>();
+                const char* p = reinterpret_cast<const char*>(in.take(length));
+                source.textures.push_back(basedir / std::filesystem::path(std::string(p, length)));
+            }
+        } catch (const std::runtime_error&) {
+            std::cerr << cache_path << ": corrupted texture table" << std::endl;
+            return std::nullopt;
+        }
+        // draw textures index the sampler array; -1 is untextured
+        for (size_t j = 0; j < source.view.draw_count; ++j) {
+            int32_t texture = source.view.draws[j].texture;
+            if (texture < -1 || texture >= static_cast<int64_t>(source.textures.size())) {
+                std::cerr << cache_path << ": corrupted draw textures" << std::endl;
+                return std::nullopt;
+            }
+        }
+
+        return mapped;
+    }
+
+    // returns the cached mesh when it matches pmx_path, otherwise builds it and refreshes the cache
+    MeshSource load(const std::string& pmx_path) {
+        std::filesystem::path basedir = std::filesystem::path(pmx_path).remove_filename();
+        std::string cache_path = cache_path_of(pmx_path);
+
+        uint64_t source_hash, source_size;
+        {
+            PMXLoader::MappedFile source(pmx_path);
+            source_hash = hash_bytes(source.data(), source.size());
+            source_size = source.size();
+        }
+
+        if (auto cached = open(cache_path, source_hash, source_size, basedir)) {
+            return std::move(*cached);
+        }
+
+        Model::Mesh mesh = Model::build_mesh(pmx_path);
+        MeshOptimizer::optimize(mesh);
+        try {
+            write(cache_path, source_hash, source_size, basedir, mesh);
+        } catch (const std::exception& e) {
+            // a read-only model directory only costs the warm start
+            std::cerr << "failed to write model cache: " << e.what() << std::endl;
+        }
+        return MeshSource(std::move(mesh));
+    }
+
+}
+
+#endif
@@ -1,7 +1,8 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(binding = 1) uniform sampler2D[8] texSampler;
+layout(binding = 1) uniform sampler2D texSampler[];
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
@@ -11,5 +12,5 @@ layout(location = 0) out vec4 outColor;
 
 void main() {
     //outColor = vec4(fragTexCoord, 0.0, 1.0);
-    outColor = texture(texSampler[fragTexID], fragTexCoord);
+    outColor = texture(texSampler[nonuniformEXT(fragTexID)], fragTexCoord);
 }
\ No newline at end of file
@@ -6,23 +6,32 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 view;
     mat4 proj;
     mat4 invModel;
+    vec4 positionScale;
+    vec4 positionBias;
+    vec4 camera;
+    float edgeOffset;
 } ubo;
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in vec2 inTexCoord;
-layout(location = 3) in uint inTexID;
+layout(location = 0) in uvec4 inPosition; // xyz: quantized position, w: overlaps the normal, unused
+layout(location = 1) in vec2 inNormal;     // octahedral
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
-layout(location = 2) out uint fragTexID;
-layout(location = 3) out uint fragEdge;
+layout(location = 2) out uint fragEdge;
+
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
 
 void main() {
-    vec3 pos = inPosition + inNormal * 0.05;
+    vec3 position = vec3(inPosition.xyz) * ubo.positionScale.xyz + ubo.positionBias.xyz;
+    vec3 normal = decodeOctahedral(inNormal);
+    vec3 pos = position + normal * ubo.edgeOffset;
     gl_Position = ubo.proj * ubo.view * ubo.model * vec4(pos, 1.0);
     fragColor = vec3(0.05, 0.05, 0.05);
-    fragTexCoord = inTexCoord;
-    fragTexID = inTexID;
+    fragTexCoord = vec2(0.0);
     fragEdge = 1;
 }
\ No newline at end of file
@@ -1,22 +1,36 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 proj;
     mat4 invModel;
+    vec4 positionScale;
+    vec4 positionBias;
+    vec4 camera;
+    float edgeOffset;
 } ubo;
 
-layout(binding = 1) uniform sampler2D[8] texSampler;
+// sized per model at allocation
+layout(binding = 1) uniform sampler2D texSampler[];
+
+layout(push_constant) uniform DrawConstants {
+    uint texID;
+    uint srgbGray;  // 1: bc4, one sRGB coded gray channel in a unorm format
+} draw;
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
-layout(location = 2) flat in uint fragTexID;
-layout(location = 3) flat in uint fragEdge;
+layout(location = 2) flat in uint fragEdge;
 
 layout(location = 0) out vec4 outColor;
 
+float srgbToLinear(float c) {
+    return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+}
+
 float toon(float diffuse) {
     if (diffuse > 0.5) {
         return diffuse = 1.0;
@@ -37,6 +51,11 @@ void main() {
         float td = toon(diffuse);
         vec4 smpColor = vec4(td, td, td, 1.0);
         //outColor = vec4(fragTexCoord, 0.0, 1.0);
-        outColor = texture(texSampler[fragTexID], fragTexCoord) * smpColor;
+        // uniform per draw today; nonuniformEXT keeps this correct if the index comes from vertex data
+        vec4 texColor = texture(texSampler[nonuniformEXT(draw.texID)], fragTexCoord);
+        if (draw.srgbGray != 0) {
+            texColor = vec4(vec3(srgbToLinear(texColor.r)), 1.0);
+        }
+        outColor = texColor * smpColor;
     }
 }
\ No newline at end of file
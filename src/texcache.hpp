@@ -0,0 +1,781 @@
+#ifndef TEXCACHE_INCLUDED
+#define TEXCACHE_INCLUDED
+
+#include "mmd.hpp"
+#include "pmxc.hpp"
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h" // declarations only; a second include would repeat STB_IMAGE_IMPLEMENTATION
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// .ktx2: a block-compressed, pre-mipped copy of a texture cached next to the source image
+//
+// encoded once on import, so a warm start maps the file and copies its level data straight into
+// the staging buffer: no image decode and no mip blits. the format follows the content:
+//   some alpha below 255     -> BC7 (mode 6), sRGB
+//   opaque, r == g == b      -> BC4. it has no sRGB variant, so the gray level is stored sRGB coded in the
+//                               UNORM format and toon_tex.frag linearizes it (linear gray bands in the darks)
+//   other opaque colour      -> BC1, sRGB
+// the file is KTX2 (identifier, header, level index, data format descriptor, key/value data,
+// levels smallest first). the source hash and size live under the "vklearn.source" key.
+namespace TextureCache {
+
+    // bump whenever the encoders or the mip filter change
+    const uint32_t VERSION = 3;
+
+    // VkFormat values
+    enum Format : uint32_t {
+        FORMAT_BC1_RGB_SRGB = 132,
+        FORMAT_BC4_UNORM = 139,  // sRGB coded gray, see above
+        FORMAT_BC7_SRGB = 146,
+    };
+
+    struct Level {
+        uint32_t width;
+        uint32_t height;
+        uint64_t offset;  // into Texture::data()
+        uint64_t size;
+    };
+
+    // a parsed .ktx2: either mapped from disk or, when it could not be written, held in bytes
+    struct Texture {
+        uint32_t format = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<Level> levels;  // levels[0] is the full size image
+        uint64_t data_offset = 0;   // every level as one range, smallest level first
+        uint64_t data_size = 0;
+        bool from_cache = false;
+
+        std::optional<PMXLoader::MappedFile> mapping;
+        std::vector<uint8_t> bytes;
+
+        const uint8_t* data() const {
+            return mapping ? mapping->data() : bytes.data();
+        }
+    };
+
+    const char* format_name(uint32_t format) {
+        switch (format) {
+            case FORMAT_BC1_RGB_SRGB: return "bc1";
+            case FORMAT_BC4_UNORM: return "bc4";
+            case FORMAT_BC7_SRGB: return "bc7";
+            default: return "unknown";
+        }
+    }
+
+    uint32_t block_bytes(uint32_t format) {
+        return format == FORMAT_BC7_SRGB ? 16 : 8;
+    }
+
+    uint64_t level_size(uint32_t format, uint32_t width, uint32_t height) {
+        return static_cast<uint64_t>((width + 3) / 4) * ((height + 3) / 4) * block_bytes(format);
+    }
+
+    uint32_t level_count(uint32_t width, uint32_t height) {
+        return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+    }
+
+    std::string cache_path_of(const std::string& texture_path) {
+        return texture_path + ".ktx2";
+    }
+
+    // ---- colour space and mips ----
+
+    float srgb_to_linear(float c) {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float linear_to_srgb(float c) {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    // 8-bit sRGB rgba -> linear float rgba; alpha is linear already
+    std::vector<float> to_linear(const uint8_t* rgba, size_t pixels) {
+        std::array<float, 256> lut;
+        for (int j = 0; j < 256; ++j) {
+            lut[j] = srgb_to_linear(j / 255.0f);
+        }
+        std::vector<float> out(pixels * 4);
+        for (size_t j = 0; j < pixels; ++j) {
+            out[4 * j + 0] = lut[rgba[4 * j + 0]];
+            out[4 * j + 1] = lut[rgba[4 * j + 1]];
+            out[4 * j + 2] = lut[rgba[4 * j + 2]];
+            out[4 * j + 3] = rgba[4 * j + 3] / 255.0f;
+        }
+        return out;
+    }
+
+    // 2x2 box filter in linear space; odd edges reuse the last row or column
+    std::vector<float> downsample(const std::vector<float>& src, uint32_t width, uint32_t height) {
+        uint32_t w = std::max(width / 2, 1u);
+        uint32_t h = std::max(height / 2, 1u);
+        std::vector<float> out(static_cast<size_t>(w) * h * 4);
+        for (uint32_t y = 0; y < h; ++y) {
+            uint32_t y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (uint32_t x = 0; x < w; ++x) {
+                uint32_t x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                for (int c = 0; c < 4; ++c) {
+                    out[(static_cast<size_t>(y) * w + x) * 4 + c] = 0.25f * (
+                        src[(static_cast<size_t>(y0) * width + x0) * 4 + c] + src[(static_cast<size_t>(y0) * width + x1) * 4 + c] +
+                        src[(static_cast<size_t>(y1) * width + x0) * 4 + c] + src[(static_cast<size_t>(y1) * width + x1) * 4 + c]);
+                }
+            }
+        }
+        return out;
+    }
+
+    // linear float rgba -> the space each encoder works in, scaled to 0..255:
+    // sRGB colour (BC4 takes channel 0), linear alpha
+    std::vector<float> to_encode_space(const std::vector<float>& linear) {
+        std::vector<float> out(linear.size());
+        for (size_t j = 0; j < linear.size(); j += 4) {
+            for (int c = 0; c < 3; ++c) {
+                out[j + c] = 255.0f * linear_to_srgb(linear[j + c]);
+            }
+            out[j + 3] = 255.0f * linear[j + 3];
+        }
+        return out;
+    }
+
+    uint32_t choose_format(const uint8_t* rgba, size_t pixels) {
+        bool gray = true;
+        for (size_t j = 0; j < pixels; ++j) {
+            const uint8_t* p = rgba + 4 * j;
+            if (p[3] != 255) {
+                return FORMAT_BC7_SRGB;
+            }
+            // jpeg chroma noise is tolerated
+            gray = gray && std::abs(p[0] - p[1]) <= 2 && std::abs(p[1] - p[2]) <= 2;
+        }
+        return gray ? FORMAT_BC4_UNORM : FORMAT_BC1_RGB_SRGB;
+    }
+
+    // ---- block encoders: 16 pixels, row-major, rgba scaled to 0..255 ----
+
+    typedef float Block[16][4];
+
+    // endpoints along the principal axis of the first n channels
+    void principal_endpoints(const Block& px, int n, float lo[4], float hi[4]) {
+        float mean[4] = {};
+        for (int j = 0; j < 16; ++j) {
+            for (int c = 0; c < n; ++c) {
+                mean[c] += px[j][c] / 16.0f;
+            }
+        }
+        float cov[4][4] = {};
+        for (int j = 0; j < 16; ++j) {
+            for (int a = 0; a < n; ++a) {
+                for (int b = 0; b < n; ++b) {
+                    cov[a][b] += (px[j][a] - mean[a]) * (px[j][b] - mean[b]);
+                }
+            }
+        }
+        float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            float next[4] = {};
+            float length = 0.0f;
+            for (int a = 0; a < n; ++a) {
+                for (int b = 0; b < n; ++b) {
+                    next[a] += cov[a][b] * axis[b];
+                }
+                length = std::max(length, std::abs(next[a]));
+            }
+            if (length == 0.0f) {
+                break;  // a flat block; any axis spans it
+            }
+            for (int a = 0; a < n; ++a) {
+                axis[a] = next[a] / length;
+            }
+        }
+        float tmin = 0.0f, tmax = 0.0f;
+        for (int j = 0; j < 16; ++j) {
+            float t = 0.0f;
+            for (int c = 0; c < n; ++c) {
+                t += (px[j][c] - mean[c]) * axis[c];
+            }
+            tmin = std::min(tmin, t);
+            tmax = std::max(tmax, t);
+        }
+        float norm = 0.0f;
+        for (int c = 0; c < n; ++c) {
+            norm += axis[c] * axis[c];
+        }
+        norm = norm > 0.0f ? norm : 1.0f;
+        for (int c = 0; c < n; ++c) {
+            lo[c] = std::clamp(mean[c] + axis[c] * tmin / norm, 0.0f, 255.0f);
+            hi[c] = std::clamp(mean[c] + axis[c] * tmax / norm, 0.0f, 255.0f);
+        }
+    }
+
+    // least squares endpoints for fixed per-pixel weights t (pixel = lo + t * (hi - lo)); false when degenerate
+    bool fit_endpoints(const Block& px, int n, const float t[16], float lo[4], float hi[4]) {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float x[4] = {}, y[4] = {};
+        for (int j = 0; j < 16; ++j) {
+            float a = 1.0f - t[j], b = t[j];
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < n; ++c) {
+                x[c] += a * px[j][c];
+                y[c] += b * px[j][c];
+            }
+        }
+        float det = aa * bb - ab * ab;
+        if (std::abs(det) < 1e-6f) {
+            return false;
+        }
+        for (int c = 0; c < n; ++c) {
+            lo[c] = std::clamp((bb * x[c] - ab * y[c]) / det, 0.0f, 255.0f);
+            hi[c] = std::clamp((aa * y[c] - ab * x[c]) / det, 0.0f, 255.0f);
+        }
+        return true;
+    }
+
+    // picks the nearest palette entry per pixel; returns the total squared error
+    template <int Entries>
+    float select_indices(const Block& px, int n, const float palette[Entries][4], uint8_t indices[16]) {
+        float total = 0.0f;
+        for (int j = 0; j < 16; ++j) {
+            float best = 1e30f;
+            for (int k = 0; k < Entries; ++k) {
+                float e = 0.0f;
+                for (int c = 0; c < n; ++c) {
+                    float d = palette[k][c] - px[j][c];
+                    e += d * d;
+                }
+                if (e < best) {
+                    best = e;
+                    indices[j] = static_cast<uint8_t>(k);
+                }
+            }
+            total += best;
+        }
+        return total;
+    }
+
+    uint16_t pack_565(const float c[4]) {
+        uint16_t r = static_cast<uint16_t>(std::lround(c[0] * 31.0f / 255.0f));
+        uint16_t g = static_cast<uint16_t>(std::lround(c[1] * 63.0f / 255.0f));
+        uint16_t b = static_cast<uint16_t>(std::lround(c[2] * 31.0f / 255.0f));
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    void unpack_565(uint16_t v, float c[4]) {
+        uint32_t r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+        c[0] = static_cast<float>((r << 3) | (r >> 2));
+        c[1] = static_cast<float>((g << 2) | (g >> 4));
+        c[2] = static_cast<float>((b << 3) | (b >> 2));
+        c[3] = 255.0f;
+    }
+
+    // four colour mode only: the three colour mode's black entry would need colour0 <= colour1
+    float encode_bc1_endpoints(const Block& px, const float lo[4], const float hi[4], uint8_t out[8]) {
+        uint16_t c0 = pack_565(hi), c1 = pack_565(lo);
+        if (c0 < c1) {
+            std::swap(c0, c1);
+        }
+        uint8_t indices[16] = {};
+        float error = 0.0f;
+        if (c0 == c1) {
+            float palette[1][4];
+            unpack_565(c0, palette[0]);
+            error = select_indices<1>(px, 3, palette, indices);
+        } else {
+            float palette[4][4];
+            unpack_565(c0, palette[0]);
+            unpack_565(c1, palette[1]);
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = std::floor((2.0f * palette[0][c] + palette[1][c]) / 3.0f);
+                palette[3][c] = std::floor((palette[0][c] + 2.0f * palette[1][c]) / 3.0f);
+            }
+            error = select_indices<4>(px, 3, palette, indices);
+        }
+        uint32_t bits = 0;
+        for (int j = 0; j < 16; ++j) {
+            bits |= static_cast<uint32_t>(indices[j]) << (2 * j);
+        }
+        std::memcpy(out, &c0, 2);
+        std::memcpy(out + 2, &c1, 2);
+        std::memcpy(out + 4, &bits, 4);
+        return error;
+    }
+
+    void encode_bc1(const Block& px, uint8_t out[8]) {
+        float lo[4], hi[4];
+        principal_endpoints(px, 3, lo, hi);
+        float error = encode_bc1_endpoints(px, lo, hi, out);
+
+        // one refinement against the chosen indices
+        static const float weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+        uint16_t c0, c1;
+        uint32_t bits;
+        std::memcpy(&c0, out, 2);
+        std::memcpy(&c1, out + 2, 2);
+        std::memcpy(&bits, out + 4, 4);
+        if (c0 == c1) {
+            return;
+        }
+        float t[16];
+        for (int j = 0; j < 16; ++j) {
+            t[j] = 1.0f - weights[(bits >> (2 * j)) & 3];  // weights run from colour0 (hi)
+        }
+        if (fit_endpoints(px, 3, t, lo, hi)) {
+            uint8_t refined[8];
+            if (encode_bc1_endpoints(px, lo, hi, refined) < error) {
+                std::memcpy(out, refined, 8);
+            }
+        }
+    }
+
+    // 8-value mode: red0 > red1, codes 0 and 1 are the endpoints, 2..7 the interpolants
+    void encode_bc4(const Block& px, uint8_t out[8]) {
+        float lo = 255.0f, hi = 0.0f;
+        for (int j = 0; j < 16; ++j) {
+            lo = std::min(lo, px[j][0]);
+            hi = std::max(hi, px[j][0]);
+        }
+        int r0 = static_cast<int>(std::lround(hi));
+        int r1 = static_cast<int>(std::lround(lo));
+        out[0] = static_cast<uint8_t>(r0);
+        out[1] = static_cast<uint8_t>(r1);
+        uint64_t bits = 0;
+        if (r0 != r1) {
+            float palette[8];
+            palette[0] = static_cast<float>(r0);
+            palette[1] = static_cast<float>(r1);
+            for (int k = 1; k < 7; ++k) {
+                palette[k + 1] = static_cast<float>(((7 - k) * r0 + k * r1) / 7);
+            }
+            for (int j = 0; j < 16; ++j) {
+                uint64_t index = 0;
+                float best = 1e30f;
+                for (int k = 0; k < 8; ++k) {
+                    float d = std::abs(palette[k] - px[j][0]);
+                    if (d < best) {
+                        best = d;
+                        index = static_cast<uint64_t>(k);
+                    }
+                }
+                bits |= index << (3 * j);
+            }
+        }
+        for (int b = 0; b < 6; ++b) {
+            out[2 + b] = static_cast<uint8_t>(bits >> (8 * b));
+        }
+    }
+
+    // appends bit fields from bit 0 up
+    struct BitWriter {
+        uint8_t* out;
+        int position = 0;
+
+        void write(uint32_t value, int bits) {
+            for (int b = 0; b < bits; ++b, ++position) {
+                out[position / 8] |= static_cast<uint8_t>(((value >> b) & 1) << (position % 8));
+            }
+        }
+    };
+
+    // 7 bits per channel plus one p-bit per endpoint; picks the p-bit with the lower error
+    void quantize_bc7_mode6(const float e[4], uint8_t c7[4], uint8_t& p) {
+        float best = 1e30f;
+        for (int bit = 0; bit < 2; ++bit) {
+            uint8_t q[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; ++c) {
+                q[c] = static_cast<uint8_t>(std::clamp<long>(std::lround((e[c] - bit) / 2.0f), 0, 127));
+                float d = (q[c] * 2 + bit) - e[c];
+                error += d * d;
+            }
+            if (error < best) {
+                best = error;
+                p = static_cast<uint8_t>(bit);
+                std::memcpy(c7, q, 4);
+            }
+        }
+    }
+
+    float encode_bc7_endpoints(const Block& px, const float lo[4], const float hi[4], uint8_t out[16]) {
+        static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+        uint8_t c7[2][4], p[2];
+        quantize_bc7_mode6(lo, c7[0], p[0]);
+        quantize_bc7_mode6(hi, c7[1], p[1]);
+        float palette[16][4];
+        for (int k = 0; k < 16; ++k) {
+            for (int c = 0; c < 4; ++c) {
+                int e0 = c7[0][c] * 2 + p[0], e1 = c7[1][c] * 2 + p[1];
+                palette[k][c] = static_cast<float>(((64 - weights[k]) * e0 + weights[k] * e1 + 32) >> 6);
+            }
+        }
+        uint8_t indices[16];
+        float error = select_indices<16>(px, 4, palette, indices);
+
+        // the anchor (pixel 0) index has an implicit 0 top bit; swapping the endpoints inverts the indices
+        int a = 0, b = 1;
+        if (indices[0] & 8) {
+            std::swap(a, b);
+            for (int j = 0; j < 16; ++j) {
+                indices[j] = static_cast<uint8_t>(15 - indices[j]);
+            }
+        }
+        std::memset(out, 0, 16);
+        BitWriter bits{out};
+        bits.write(1 << 6, 7);  // mode 6
+        for (int c = 0; c < 4; ++c) {
+            bits.write(c7[a][c], 7);
+            bits.write(c7[b][c], 7);
+        }
+        bits.write(p[a], 1);
+        bits.write(p[b], 1);
+        bits.write(indices[0], 3);
+        for (int j = 1; j < 16; ++j) {
+            bits.write(indices[j], 4);
+        }
+        return error;
+    }
+
+    // mode 6: one subset, rgba endpoints, 4-bit indices
+    void encode_bc7(const Block& px, uint8_t out[16]) {
+        static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+        float lo[4], hi[4];
+        principal_endpoints(px, 4, lo, hi);
+        float error = encode_bc7_endpoints(px, lo, hi, out);
+
+        // recover each pixel's weight, then one refinement against them
+        float t[16];
+        float palette[16][4];
+        for (int k = 0; k < 16; ++k) {
+            for (int c = 0; c < 4; ++c) {
+                palette[k][c] = lo[c] + (hi[c] - lo[c]) * weights[k] / 64.0f;
+            }
+        }
+        uint8_t indices[16];
+        select_indices<16>(px, 4, palette, indices);
+        for (int j = 0; j < 16; ++j) {
+            t[j] = weights[indices[j]] / 64.0f;
+        }
+        if (fit_endpoints(px, 4, t, lo, hi)) {
+            uint8_t refined[16];
+            if (encode_bc7_endpoints(px, lo, hi, refined) < error) {
+                std::memcpy(out, refined, 16);
+            }
+        }
+    }
+
+    // encodes one level (encode space, see to_encode_space); block rows are split across threads
+    std::vector<uint8_t> encode_level(uint32_t format, const float* pixels, uint32_t width, uint32_t height, unsigned threads) {
+        uint32_t blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+        uint32_t bytes = block_bytes(format);
+        std::vector<uint8_t> out(static_cast<size_t>(blocks_x) * blocks_y * bytes);
+
+        auto encode_rows = [&](uint32_t first, uint32_t last) {
+            for (uint32_t by = first; by < last; ++by) {
+                for (uint32_t bx = 0; bx < blocks_x; ++bx) {
+                    Block block;
+                    for (uint32_t j = 0; j < 16; ++j) {
+                        // edge blocks repeat the last row or column
+                        uint32_t x = std::min(bx * 4 + j % 4, width - 1);
+                        uint32_t y = std::min(by * 4 + j / 4, height - 1);
+                        std::memcpy(block[j], pixels + (static_cast<size_t>(y) * width + x) * 4, sizeof(block[j]));
+                    }
+                    uint8_t* dst = out.data() + (static_cast<size_t>(by) * blocks_x + bx) * bytes;
+                    switch (format) {
+                        case FORMAT_BC1_RGB_SRGB: encode_bc1(block, dst); break;
+                        case FORMAT_BC4_UNORM: encode_bc4(block, dst); break;
+                        default: encode_bc7(block, dst); break;
+                    }
+                }
+            }
+        };
+
+        threads = std::max(1u, std::min<unsigned>(threads, blocks_y));
+        std::vector<std::thread> workers;
+        uint32_t rows = (blocks_y + threads - 1) / threads;
+        for (unsigned t = 1; t < threads; ++t) {
+            uint32_t first = std::min(t * rows, blocks_y), last = std::min(first + rows, blocks_y);
+            workers.emplace_back(encode_rows, first, last);
+        }
+        encode_rows(0, std::min(rows, blocks_y));
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        return out;
+    }
+
+    // ---- KTX2 container ----
+
+    const uint8_t IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+    const char SOURCE_KEY[] = "vklearn.source";
+
+    struct Header {
+        uint32_t vk_format;
+        uint32_t type_size;
+        uint32_t pixel_width;
+        uint32_t pixel_height;
+        uint32_t pixel_depth;
+        uint32_t layer_count;
+        uint32_t face_count;
+        uint32_t level_count;
+        uint32_t supercompression_scheme;
+        uint32_t dfd_byte_offset;
+        uint32_t dfd_byte_length;
+        uint32_t kvd_byte_offset;
+        uint32_t kvd_byte_length;
+        uint64_t sgd_byte_offset;
+        uint64_t sgd_byte_length;
+    };
+
+    struct LevelIndex {
+        uint64_t byte_offset;
+        uint64_t byte_length;
+        uint64_t uncompressed_byte_length;
+    };
+
+    struct SourceStamp {
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t hash;
+        uint64_t size;
+    };
+
+    // a basic data format descriptor with one sample covering the whole block
+    std::vector<uint8_t> data_format_descriptor(uint32_t format) {
+        uint8_t color_model = format == FORMAT_BC1_RGB_SRGB ? 128 : format == FORMAT_BC4_UNORM ? 131 : 134;
+        uint8_t transfer = 2;  // sRGB, BC4 included: it describes the stored values, not the vk format
+        uint32_t words[11] = {
+            44,                                 // total size
+            0,                                  // vendor khronos, basic descriptor
+            2 | (40u << 16),                    // version 2, block size 24 + 16 per sample
+            color_model | (1u << 8) | (static_cast<uint32_t>(transfer) << 16),  // bt709 primaries, straight alpha
+            3 | (3u << 8),                      // 4x4x1x1 texel blocks
+            block_bytes(format),                // bytes in plane 0
+            0,
+            (block_bytes(format) * 8 - 1) << 16,  // sample: bit offset 0, bit length, channel 0
+            0,                                  // sample position
+            0,                                  // sample lower
+            0xFFFFFFFFu,                        // sample upper
+        };
+        std::vector<uint8_t> out(sizeof(words));
+        std::memcpy(out.data(), words, sizeof(words));
+        return out;
+    }
+
+    void append_key_value(std::vector<uint8_t>& kvd, const char* key, const void* value, size_t size) {
+        uint32_t length = static_cast<uint32_t>(std::strlen(key) + 1 + size);
+        const uint8_t* l = reinterpret_cast<const uint8_t*>(&length);
+        kvd.insert(kvd.end(), l, l + sizeof(length));
+        kvd.insert(kvd.end(), key, key + std::strlen(key) + 1);
+        kvd.insert(kvd.end(), static_cast<const uint8_t*>(value), static_cast<const uint8_t*>(value) + size);
+        kvd.resize((kvd.size() + 3) & ~size_t(3));
+    }
+
+    // the whole .ktx2 file image; levels[0] is the full size level
+    std::vector<uint8_t> serialize(uint32_t format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels, uint64_t source_hash, uint64_t source_size) {
+        uint32_t level_count = static_cast<uint32_t>(levels.size());
+        std::vector<uint8_t> dfd = data_format_descriptor(format);
+        std::vector<uint8_t> kvd;
+        const char writer[] = "vklearn";
+        append_key_value(kvd, "KTXwriter", writer, sizeof(writer));
+        SourceStamp stamp{VERSION, 0, source_hash, source_size};
+        append_key_value(kvd, SOURCE_KEY, &stamp, sizeof(stamp));
+
+        Header header{};
+        header.vk_format = format;
+        header.type_size = 1;
+        header.pixel_width = width;
+        header.pixel_height = height;
+        header.face_count = 1;
+        header.level_count = level_count;
+        header.dfd_byte_offset = static_cast<uint32_t>(sizeof(IDENTIFIER) + sizeof(Header) + level_count * sizeof(LevelIndex));
+        header.dfd_byte_length = static_cast<uint32_t>(dfd.size());
+        header.kvd_byte_offset = header.dfd_byte_offset + header.dfd_byte_length;
+        header.kvd_byte_length = static_cast<uint32_t>(kvd.size());
+
+        // smallest level first, each aligned to 16 so staging copies keep the block alignment
+        std::vector<LevelIndex> index(level_count);
+        uint64_t offset = header.kvd_byte_offset + header.kvd_byte_length;
+        for (uint32_t j = level_count; j-- > 0;) {
+            offset = (offset + 15) & ~uint64_t(15);
+            index[j] = {offset, levels[j].size(), levels[j].size()};
+            offset += levels[j].size();
+        }
+
+        std::vector<uint8_t> out(offset);
+        uint8_t* p = out.data();
+        std::memcpy(p, IDENTIFIER, sizeof(IDENTIFIER));
+        std::memcpy(p + sizeof(IDENTIFIER), &header, sizeof(Header));
+        std::memcpy(p + sizeof(IDENTIFIER) + sizeof(Header), index.data(), index.size() * sizeof(LevelIndex));
+        std::memcpy(p + header.dfd_byte_offset, dfd.data(), dfd.size());
+        std::memcpy(p + header.kvd_byte_offset, kvd.data(), kvd.size());
+        for (uint32_t j = 0; j < level_count; ++j) {
+            std::memcpy(p + index[j].byte_offset, levels[j].data(), levels[j].size());
+        }
+        return out;
+    }
+
+    // validates a .ktx2 file image against the source; fills everything but the storage
+    std::optional<Texture> parse(const uint8_t* base, size_t size, uint64_t source_hash, uint64_t source_size) {
+        Header header;
+        if (size < sizeof(IDENTIFIER) + sizeof(Header) || std::memcmp(base, IDENTIFIER, sizeof(IDENTIFIER)) != 0) {
+            return std::nullopt;
+        }
+        std::memcpy(&header, base + sizeof(IDENTIFIER), sizeof(Header));
+        if ((header.vk_format != FORMAT_BC1_RGB_SRGB && header.vk_format != FORMAT_BC4_UNORM && header.vk_format != FORMAT_BC7_SRGB)
+            || header.pixel_width == 0 || header.pixel_height == 0 || header.pixel_depth != 0
+            || header.layer_count != 0 || header.face_count != 1 || header.supercompression_scheme != 0
+            || header.level_count == 0 || header.level_count > level_count(header.pixel_width, header.pixel_height)
+            || size < sizeof(IDENTIFIER) + sizeof(Header) + header.level_count * sizeof(LevelIndex)
+            || header.kvd_byte_offset > size || header.kvd_byte_length > size - header.kvd_byte_offset) {
+            return std::nullopt;
+        }
+
+        bool stamped = false;
+        try {
+            PMXLoader::ByteCursor in(base + header.kvd_byte_offset, header.kvd_byte_length);
+            while (in.remaining() >= sizeof(uint32_t)) {
+                uint32_t length = in.read<uint32_t>();
+                const uint8_t* entry = in.take(length);
+                in.take(std::min<size_t>((4 - length % 4) % 4, in.remaining()));
+                if (length == sizeof(SOURCE_KEY) + sizeof(SourceStamp) && std::memcmp(entry, SOURCE_KEY, sizeof(SOURCE_KEY)) == 0) {
+                    SourceStamp stamp;
+                    std::memcpy(&stamp, entry + sizeof(SOURCE_KEY), sizeof(stamp));
+                    stamped = stamp.version == VERSION && stamp.hash == source_hash && stamp.size == source_size;
+                }
+            }
+        } catch (const std::runtime_error&) {
+            return std::nullopt;
+        }
+        if (!stamped) {
+            return std::nullopt;
+        }
+
+        Texture texture;
+        texture.format = header.vk_format;
+        texture.width = header.pixel_width;
+        texture.height = header.pixel_height;
+        uint64_t first = UINT64_MAX, last = 0;
+        for (uint32_t j = 0; j < header.level_count; ++j) {
+            LevelIndex index;
+            std::memcpy(&index, base + sizeof(IDENTIFIER) + sizeof(Header) + j * sizeof(LevelIndex), sizeof(LevelIndex));
+            uint32_t w = std::max(header.pixel_width >> j, 1u), h = std::max(header.pixel_height >> j, 1u);
+            if (index.byte_offset > size || index.byte_length > size - index.byte_offset || index.byte_offset % 16 != 0
+                || index.byte_length != level_size(header.vk_format, w, h)) {
+                return std::nullopt;
+            }
+            texture.levels.push_back({w, h, index.byte_offset, index.byte_length});
+            first = std::min(first, index.byte_offset);
+            last = std::max(last, index.byte_offset + index.byte_length);
+        }
+        texture.data_offset = first;
+        texture.data_size = last - first;
+        return texture;
+    }
+
+    // maps cache_path and validates it against the source; returns nullopt on any mismatch
+    std::optional<Texture> open(const std::string& cache_path, uint64_t source_hash, uint64_t source_size) {
+        if (!std::filesystem::exists(cache_path)) {
+            return std::nullopt;
+        }
+        std::optional<PMXLoader::MappedFile> mapping;
+        try {
+            mapping.emplace(cache_path);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return std::nullopt;
+        }
+        std::optional<Texture> texture = parse(mapping->data(), mapping->size(), source_hash, source_size);
+        if (texture) {
+            texture->from_cache = true;
+            texture->mapping.emplace(std::move(*mapping));
+        }
+        return texture;
+    }
+
+    void write(const std::string& cache_path, const std::vector<uint8_t>& file) {
+        // write to a temporary file and rename, so a crash never leaves a half-written cache
+        std::string tmp_path = cache_path + ".tmp";
+        {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                throw std::runtime_error("failed to open file: " + tmp_path);
+            }
+            out.write(reinterpret_cast<const char*>(file.data()), file.size());
+            if (!out) {
+                throw std::runtime_error("failed to write file: " + tmp_path);
+            }
+        }
+        std::filesystem::rename(tmp_path, cache_path);
+    }
+
+    // encodes already decoded rgba into .ktx2 bytes: box-filters the mip chain in linear space, then
+    // encodes every level in the format choose_format picks, each with up to threads threads
+    std::vector<uint8_t> build(const uint8_t* rgba, uint32_t width, uint32_t height, unsigned threads, uint64_t source_hash, uint64_t source_size) {
+        uint32_t format = choose_format(rgba, static_cast<size_t>(width) * height);
+        std::vector<std::vector<uint8_t>> levels;
+        std::vector<float> linear = to_linear(rgba, static_cast<size_t>(width) * height);
+        uint32_t w = width, h = height;
+        for (uint32_t j = 0; j < level_count(width, height); ++j) {
+            if (j > 0) {
+                linear = downsample(linear, w, h);
+                w = std::max(w / 2, 1u);
+                h = std::max(h / 2, 1u);
+            }
+            std::vector<float> encode_space = to_encode_space(linear);
+            levels.push_back(encode_level(format, encode_space.data(), w, h, threads));
+        }
+        return serialize(format, width, height, levels, source_hash, source_size);
+    }
+
+    // returns the cached texture when it matches texture_path, otherwise encodes it and refreshes the cache.
+    // throws when the source cannot be decoded.
+    Texture load(const std::string& texture_path, unsigned threads) {
+        std::string cache_path = cache_path_of(texture_path);
+
+        uint64_t source_hash, source_size;
+        {
+            PMXLoader::MappedFile source(texture_path);
+            source_hash = PMXCache::hash_bytes(source.data(), source.size());
+            source_size = source.size();
+        }
+
+        if (auto cached = open(cache_path, source_hash, source_size)) {
+            return std::move(*cached);
+        }
+
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load(texture_path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!pixels) {
+            throw std::runtime_error(stbi_failure_reason() ? stbi_failure_reason() : "unknown error");
+        }
+        std::vector<uint8_t> file = build(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), threads, source_hash, source_size);
+        stbi_image_free(pixels);
+
+        try {
+            write(cache_path, file);
+            if (auto written = open(cache_path, source_hash, source_size)) {
+                written->from_cache = false;
+                return std::move(*written);
+            }
+        } catch (const std::exception& e) {
+            // a read-only texture directory only costs the warm start
+            std::cerr << "failed to write texture cache: " << e.what() << std::endl;
+        }
+        Texture texture = *parse(file.data(), file.size(), source_hash, source_size);
+        texture.bytes = std::move(file);
+        return texture;
+    }
+
+}
+
+#endif
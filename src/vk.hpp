@@ -37,6 +37,8 @@ namespace vklearn {
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
+        // optional: a family with transfer but no graphics support, usually a dedicated copy engine
+        std::optional<uint32_t> transferFamily;
 
         bool isComplete() {
             return graphicsFamily.has_value() && presentFamily.has_value();
@@ -183,6 +185,15 @@ namespace vklearn {
 
             idx++;
         }
+
+        // prefer transfer-only over compute+transfer families
+        for (uint32_t j = 0; j < queueFamilies.size(); ++j) {
+            vk::QueueFlags flags = queueFamilies[j].queueFlags;
+            if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & vk::QueueFlagBits::eGraphics)
+                && (!indices.transferFamily || !(flags & vk::QueueFlagBits::eCompute))) {
+                indices.transferFamily = j;
+            }
+        }
         return indices;
     }
 
@@ -219,6 +230,23 @@ namespace vklearn {
             return 0;
         }
 
+        // timeline semaphores, which order the asynchronous uploads, are core from 1.2
+        if (props.apiVersion < VK_API_VERSION_1_2) {
+            std::cerr << "Not supported: Vulkan 1.2" << std::endl;
+            return 0;
+        }
+
+        // descriptor indexing for the bindless texture array
+        auto features12 = device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>().get<vk::PhysicalDeviceVulkan12Features>();
+        if (!features12.runtimeDescriptorArray
+            || !features12.shaderSampledImageArrayNonUniformIndexing
+            || !features12.descriptorBindingPartiallyBound
+            || !features12.descriptorBindingVariableDescriptorCount
+            || !features12.descriptorBindingSampledImageUpdateAfterBind) {
+            std::cerr << "Not supported: Descriptor indexing" << std::endl;
+            return 0;
+        }
+
         if (!indices.isComplete()) {
             std::cerr << "Not found: Required queue families" << std::endl;
             return 0;
@@ -364,9 +392,8 @@ namespace vklearn {
         return format == vk::Format::eD32SfloatS8Uint || format == vk::Format::eD24UnormS8Uint;
     }
 
-    void transitionImageLayout(vk::Device device, vk::CommandPool commandPool, vk::Queue graphicsQueue, vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, uint32_t mipLevels) {
-        vk::CommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
-
+    // records the barrier into commandBuffer; transitionImageLayout submits it on its own
+    void recordImageLayoutTransition(vk::CommandBuffer commandBuffer, vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, uint32_t mipLevels) {
         vk::ImageMemoryBarrier barrier{};
         barrier.oldLayout = oldLayout;
         barrier.newLayout = newLayout;
@@ -423,15 +450,18 @@ namespace vklearn {
             0, nullptr,
             1, &barrier
         );
-
-        endSingleTimeCommands(device, commandPool, commandBuffer, graphicsQueue);
     }
 
-    void copyBufferToImage(vk::Device device, vk::CommandPool commandPool, vk::Queue graphicsQueue, vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height) {
+    void transitionImageLayout(vk::Device device, vk::CommandPool commandPool, vk::Queue graphicsQueue, vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, uint32_t mipLevels) {
         vk::CommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
+        recordImageLayoutTransition(commandBuffer, image, format, oldLayout, newLayout, mipLevels);
+        endSingleTimeCommands(device, commandPool, commandBuffer, graphicsQueue);
+    }
 
+    // copies tightly packed texels at bufferOffset into mip 0 of image, which must be in eTransferDstOptimal
+    void recordCopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Buffer buffer, vk::DeviceSize bufferOffset, vk::Image image, uint32_t width, uint32_t height) {
         vk::BufferImageCopy region{};
-        region.bufferOffset = 0;
+        region.bufferOffset = bufferOffset;
         region.bufferRowLength = 0;
         region.bufferImageHeight = 0;
 
@@ -455,7 +485,11 @@ namespace vklearn {
             1,
             &region
         );
+    }
 
+    void copyBufferToImage(vk::Device device, vk::CommandPool commandPool, vk::Queue graphicsQueue, vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height) {
+        vk::CommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
+        recordCopyBufferToImage(commandBuffer, buffer, 0, image, width, height);
         endSingleTimeCommands(device, commandPool, commandBuffer, graphicsQueue);
     }
 